@@ -6,9 +6,149 @@
 #include <unordered_map>
 #include <memory>
 #include <random>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <future>
+#include <span>
+#include <string_view>
 #include "../../src/Node.h"
+#include "../../src/NodeView.h"
+#include "../../src/Factor.h"
+#include "../../src/Stats.h"
+#include "../../src/Trace.h"
+#include "../../src/ThreadPool.h"
+#include "../../src/MappedFile.h"
+#include "../../src/CptStore.h"
 
 namespace baynet {
+    // how the cpts of a graph are stored
+    enum class CptStorage {
+        Float, // float tables, shared between the nodes (and the graphs) with the same cpt
+        Fixed16 // 16-bit fixed-point cumulative distributions (see QuantizedCpt for the error bound), shared between the nodes of the graph
+    };
+
+    // prior of the parameter learning
+    enum class ParameterPrior {
+        MaximumLikelihood, // relative frequencies (the rows of parent configurations that never occur become uniform)
+        Dirichlet, // pseudo_count is added to every count (Laplace smoothing with 1)
+        BDeu // equivalent_sample_size / (rows * states) is added to every count of a cpt
+    };
+
+    // options of the parameter learning
+    struct LearnOptions {
+        ParameterPrior prior = ParameterPrior::MaximumLikelihood;
+        double pseudo_count = 1; // Dirichlet
+        double equivalent_sample_size = 1; // BDeu
+    };
+
+    // options of the expectation-maximisation learning (see Graph::learn_parameters_em)
+    struct EmOptions {
+        LearnOptions learn; // prior of the M-step
+        int max_iterations = 50;
+        double tolerance = 1e-6; // stops when the log-likelihood changes by less than tolerance times its value
+        int algorithm = 2; // engine of the E-step: 2 variable elimination (exact), 0 likelihood weighting for networks too large for it
+        int num_samples = 1000; // samples of each case with likelihood weighting
+    };
+
+    // result of the expectation-maximisation learning
+    struct EmResult {
+        size_t cases = 0; // lines of the file
+        int iterations = 0;
+        double log_likelihood = 0; // log-likelihood of the cases (natural log) under the cpts of the last E-step
+        bool converged = false; // the tolerance was reached before max_iterations
+        size_t impossible_cases = 0; // cases with probability 0 in the last E-step, left out of the counts
+    };
+
+    using NodeId = int; // index of a node in node_list
+    using StateId = int; // index of a state of a node
+
+    // evidence of the typed query API: the node is in the given state
+    struct EvidenceItem {
+        NodeId node;
+        StateId state;
+    };
+
+    // flag shared by its copies: a query holding a copy stops sampling soon after cancel is called on any of them
+    class CancellationToken {
+    public:
+        CancellationToken() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+        void cancel() const { flag->store(true, std::memory_order_relaxed); }
+
+        bool is_cancelled() const { return flag->load(std::memory_order_relaxed); }
+
+    private:
+        std::shared_ptr<std::atomic<bool>> flag;
+    };
+
+    // limits of a query: the sampling stops at the deadline or when the token is cancelled, whichever comes first
+    struct QueryControl {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        CancellationToken cancellation;
+
+        bool stop_requested() const {
+            return cancellation.is_cancelled() ||
+                   (deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline);
+        }
+    };
+
+    // result of an MPE or MAP query
+    struct Explanation {
+        std::vector<EvidenceItem> assignment; // best state of each explained node, in the order of node_list
+        double log_probability = 0; // natural log of the joint probability of the assignment and the evidence, -infinity if the evidence is impossible
+        int steps = 0; // steps of the local search (0 for the exact engine)
+    };
+
+    // estimate of the probability of an evidence
+    struct EvidenceProbability {
+        double probability = 1; // P(evidence)
+        double variance = 0; // variance of the estimate (0 for the exact engine)
+        int samples_used = 0; // samples actually drawn (0 for the exact engine)
+    };
+
+    // result of a query with a QueryControl
+    struct QueryResult {
+        std::vector<float> probabilities;
+        int samples_used = 0; // samples actually drawn: num_samples unless the query was stopped, 0 for variable elimination
+        bool stopped = false; // the deadline or the cancellation stopped the sampling before num_samples
+    };
+
+    // options of the loading of a network
+    struct LoadOptions {
+        /*
+         * Reads only the structure of the network at load time and keeps the file mapped:
+         * each cpt is parsed the first time it is needed by a query, print_node or edit_cpt.
+         * Meant for large networks of which only a part is queried. Errors in a cpt are reported on its first use
+         */
+        bool lazy_cpts = false;
+
+        /*
+         * Storage of the cpts. Fixed16 needs 2 bytes for each state of a row but the last one, instead of a float for each state
+         * plus a vector for each row, and samples without converting back to floats, at the price of an error of at most
+         * 1/65535 on every probability.
+         * Deterministic and noisy-MAX nodes keep their own compact representation
+         */
+        CptStorage cpt_storage = CptStorage::Float;
+
+        /*
+         * Nodes of unsupported types (e.g. equation nodes) are always ignored. A node that has one of them as a parent is
+         * skipped too, together with the nodes that depend on it, with a warning on std::cerr: the graph keeps the part of
+         * the network that does not depend on the unsupported nodes (see Graph::skipped_nodes). When unset, such a node
+         * makes the loading fail instead
+         */
+        bool skip_unsupported_nodes = true;
+
+        /*
+         * Workers of the loading and of the queries. When null, the graph uses the pool shared by the whole process
+         * (ThreadPool::shared), like all the other graphs loaded without one: many graphs (e.g. of a NetworkRegistry) do not
+         * start a set of threads each. A pool of its own isolates the graph from the load of the others
+         */
+        std::shared_ptr<ThreadPool> pool;
+    };
+
     /*
      * Class that models the graph of a Bayesian network.
      * The construction of the object takes place by indicating an .xdsl file as input
@@ -17,8 +157,13 @@ namespace baynet {
     class Graph {
     public:
 
-        //constructor: it takes the file path as input
-        explicit Graph(const std::string& filename);
+        //constructor: it takes the file path as input (absolute, or relative to the project root).
+        //The float cpts are deduplicated in a cpt store of the graph
+        explicit Graph(const std::string& filename, const LoadOptions& options = {});
+
+        //like the other constructor, but the float cpts are deduplicated in store, which can be shared with other graphs
+        //(see NetworkRegistry). When the graph is destroyed only the cpts that no other graph uses are dropped
+        Graph(const std::string& filename, const LoadOptions& options, std::shared_ptr<CptStore> store);
 
         //destructor
         ~Graph();
@@ -28,14 +173,39 @@ namespace baynet {
         //given the name of the node and a probabilities list it edits an existing node' cpt
         void edit_cpt(const std::string& name, const std::string& problist);
 
-        //return the probs_hashmap size
+        /*
+         * Learns every cpt from a CSV file of complete cases (absolute, or relative to the project root): the header has the names
+         * of the nodes (other columns are ignored), every line a state of each node, by name or by index.
+         * The file is mapped in memory and the counts are taken by all the workers, each one on its own part of the file,
+         * then merged. The nodes become regular cpt nodes. Returns the number of cases.
+         * Throws std::runtime_error if the file can not be read or has no case, a node has no column or a value is missing or unknown
+         */
+        size_t learn_parameters(const std::string& csv_path, const LearnOptions& options = {});
+
+        /*
+         * Learns every cpt from a CSV file with missing values ("" or "?"), by expectation-maximisation starting from the current cpts.
+         * Nodes without a column are latent. The E-step takes the expected counts of every case from the engine of options.algorithm,
+         * in parallel over the cases: identical lines are processed once, and the lines with the same missing values share their
+         * list of hidden nodes and of the families to update. After each M-step the cpts are replaced like in edit_cpt.
+         * Throws std::runtime_error if the file can not be read, has no case or a value is unknown, std::invalid_argument if the
+         * algorithm is not 0 or 2
+         */
+        EmResult learn_parameters_em(const std::string& csv_path, const EmOptions& options = {});
+
+        //return the number of cpts in the cpt store of the graph (shared with the other graphs of the store)
         size_t get_map_size();
 
+        //given an hashed cpt (see Node::get_hashed_cpt) it returns its reference counter: the nodes using it plus the store
+        long get_cpt_count(const std::string& hashed_cpt) const;
+
+        //returns the cpt store of the graph
+        const std::shared_ptr<CptStore>& get_cpt_store() const;
+
         //given the name of the node, it prints:
         //name, parents, states, hashed cpt, cpt counter of that node
         void print_node(const std::string& name);
 
-        //prints the whole probs_hashmap
+        //prints the whole cpt store
         void print_map();
 
         // given a number of samples and an evidence it performs inference using one of the implemented algorithms.
@@ -43,6 +213,7 @@ namespace baynet {
         // you can choose which algorithm to use with an integer:
         //      0: likelihood weighting (default)
         //      1: rejection sampling
+        //      2: variable elimination (exact)
         std::unordered_map<std::string, std::vector<float>> inference(int num_samples=1000, const std::string& evidence="", int algorithm=0);
 
         // given a number of samples and an evidence it performs inference on the query variable using one of the implemented algorithms.
@@ -50,8 +221,123 @@ namespace baynet {
         // you can choose which algorithm to use with an integer:
         //      0: likelihood weighting (default)
         //      1: rejection sampling
+        //      2: variable elimination (exact)
         std::vector<float> single_node_inference(const std::string& query, int num_samples=1000, int algorithm=0);
 
+        // like the string versions, stopped by control (see the typed single_node_inference). Errors are printed and the result is empty
+        std::unordered_map<std::string, QueryResult> inference(int num_samples, const std::string& evidence, int algorithm,
+                                                               const QueryControl& control);
+        QueryResult single_node_inference(const std::string& query, int num_samples, int algorithm, const QueryControl& control);
+
+        /*
+         * Typed version of single_node_inference: the query and the evidence are ids (see resolve_node, resolve_state and
+         * resolve_evidence), so nothing is parsed or looked up by name. The string API is a wrapper of this one.
+         * Without evidence the sampling algorithms draw from the prior.
+         * Unlike the string version, it throws std::invalid_argument if an id or the algorithm are not valid instead of printing the error
+         */
+        std::vector<float> single_node_inference(NodeId query, std::span<const EvidenceItem> evidence, int num_samples=1000, int algorithm=0);
+
+        /*
+         * Like the typed single_node_inference, but the sampling stops at the deadline or at the cancellation of control.
+         * The workers check them every few hundred samples and the estimate of the samples drawn so far is returned,
+         * with their number. The first few hundred samples are always drawn, so that there is an estimate.
+         * Variable elimination is exact and is not interrupted
+         */
+        QueryResult single_node_inference(NodeId query, std::span<const EvidenceItem> evidence, int num_samples, int algorithm,
+                                          const QueryControl& control);
+
+        // typed version of inference: the posterior of every node, in the order of node_list, stopped by control.
+        // Once control is stopped each remaining node only draws its first few hundred samples. Throws like single_node_inference
+        std::vector<QueryResult> inference(std::span<const EvidenceItem> evidence, int num_samples, int algorithm,
+                                           const QueryControl& control);
+
+        /*
+         * Joint query P(X1, ..., Xk | evidence), returned as a flat table laid out like the cpts: the index of a joint state is
+         * the mixed-radix number of the states of the nodes, in the given order, the last one changing fastest.
+         * The sampling algorithms fill a histogram of the joint states, variable elimination returns the product factor.
+         * Throws std::invalid_argument if an id or the algorithm are not valid, a node is repeated or the table has more than 2^24 entries
+         */
+        std::vector<float> joint_inference(std::span<const NodeId> query, std::span<const EvidenceItem> evidence, int num_samples=1000,
+                                           int algorithm=0);
+
+        // like joint_inference, stopped by control (see single_node_inference)
+        QueryResult joint_inference(std::span<const NodeId> query, std::span<const EvidenceItem> evidence, int num_samples, int algorithm,
+                                    const QueryControl& control);
+
+        /*
+         * Non-blocking versions of the queries: they return at once, and the query runs on the pool of the graph (shared with
+         * the other graphs, see LoadOptions::pool) together with its sampling tasks, so many queries can run concurrently
+         * without a caller thread for each one. A running query holds a worker until it ends: while it waits for its
+         * sampling tasks the worker runs the queued tasks, its own or those of other queries, so a pool busy with many
+         * queries delays all of them but never runs out of workers.
+         * Errors (std::invalid_argument included) are stored in the future instead of being printed.
+         * The graph must outlive the futures: it waits for its queued and running queries when it is destroyed
+         */
+        std::future<std::vector<float>> single_node_inference_async(NodeId query, std::vector<EvidenceItem> evidence,
+                                                                    int num_samples=1000, int algorithm=0);
+
+        // like the blocking query with a QueryControl: cancelling its token stops the query, queued or running
+        std::future<QueryResult> single_node_inference_async(NodeId query, std::vector<EvidenceItem> evidence, int num_samples,
+                                                             int algorithm, QueryControl control);
+
+        // query is in the form: "VarName|Var1=StateX,Var2=StateY,..." (see single_node_inference)
+        std::future<std::vector<float>> single_node_inference_async(const std::string& query, int num_samples=1000, int algorithm=0);
+
+        // evidence is in the form: "Var1=StateX,Var2=StateY,..." (see inference)
+        std::future<std::unordered_map<std::string, std::vector<float>>> inference_async(int num_samples=1000, const std::string& evidence="",
+                                                                                         int algorithm=0);
+
+        // returns the id of the node with the given name. Throws std::invalid_argument if there is no such node
+        NodeId resolve_node(std::string_view name) const;
+
+        // returns the id of a state of the node. Throws std::invalid_argument if the node or the state are unknown
+        StateId resolve_state(NodeId node, std::string_view state) const;
+
+        // resolves an evidence in the form "Var1=StateX,Var2=StateY,..." once, so that it can be used by many typed queries.
+        // Throws std::invalid_argument if a node or a state are unknown
+        std::vector<EvidenceItem> resolve_evidence(const std::string& evidence) const;
+
+        /*
+         * Returns P(evidence), with the variance of the estimate. The algorithms are the ones of single_node_inference:
+         * likelihood weighting estimates it as the mean of the weights, rejection sampling as the fraction of the prior samples
+         * that agree with the evidence, variable elimination computes it exactly. Only the ancestors of the evidence are used.
+         * The sampling stops early if control requests so, after at least one sample. Throws std::invalid_argument if an id or the
+         * algorithm are not valid, or if num_samples is not positive with a sampling algorithm
+         */
+        EvidenceProbability evidence_probability(std::span<const EvidenceItem> evidence, int num_samples=1000, int algorithm=0,
+                                                 const QueryControl& control = {});
+
+        /*
+         * Returns ln P(row) for each row of states, a column-major matrix with a column of n_rows states for each node of node_list:
+         * states[i * n_rows + r] is the state of node i in row r, -1 if it is missing (-infinity for the impossible rows).
+         * The complete rows are scored in blocks, with a gather of the log cpt of each node at the row selected by the parents;
+         * the rows with missing values get the probability of their observed states from variable elimination.
+         * The blocks are scored by all the workers. Throws std::invalid_argument if the size of states or a state is not valid
+         */
+        std::vector<double> score_rows(std::span<const int> states, size_t n_rows);
+
+        /*
+         * Most probable explanation: the most likely joint state of all the nodes without evidence, computed exactly with
+         * max-product variable elimination. Its cost grows with the treewidth of the network: see approximate_mpe for large ones.
+         * Throws std::invalid_argument if an id of the evidence is out of range
+         */
+        Explanation most_probable_explanation(std::span<const EvidenceItem> evidence);
+
+        /*
+         * Maximum a posteriori: the most likely joint state of the given nodes, summing over all the others, computed exactly
+         * (the other nodes are summed out before the given ones are maximised). Nodes with evidence keep their evidence state.
+         * Throws std::invalid_argument if an id is out of range
+         */
+        Explanation maximum_a_posteriori(std::span<const NodeId> nodes, std::span<const EvidenceItem> evidence);
+
+        /*
+         * Anytime approximation of the most probable explanation: simulated annealing on the joint state of the nodes, restarted
+         * from a weighted sample every few thousand steps. Nodes with evidence are fixed and deterministic nodes follow their parents.
+         * Runs max_steps steps, or until control stops it, and returns the best explanation found.
+         * Throws std::invalid_argument if an id of the evidence is out of range
+         */
+        Explanation approximate_mpe(std::span<const EvidenceItem> evidence, const QueryControl& control = {}, int max_steps = 100000);
+
         //function to print the probabilities of a all nodes given the evidence: posterior = query|evidence
         //best to use with Graph::inference
         static void pretty_print(const std::unordered_map<std::string, std::vector<float>>& map);
@@ -61,19 +347,6 @@ namespace baynet {
         static void pretty_print_query(const std::vector<float>& results, const std::string& query);
 
 
-        // list of all the network nodes in topological order
-        std::vector<Node> node_list;
-
-        // given the node name it returns the index for node_list
-        std::unordered_map<std::string,int> node_indexes;
-
-    private:
-        /*
-         *  Generates a random state for a node according to its probability distribution.
-         *  Return the name of the state
-         */
-        std::string generate_sample(const std::vector<float>& cond_probs, const std::vector<std::string>& states);
-
         /*
          *  Generates a sample from the network.
          *  Each variable is sampled according to the conditional distribution given the values already sampled for the parents
@@ -87,27 +360,280 @@ namespace baynet {
          *  Each non-evidence variable is sampled according to the conditional distribution given the values already sampled for the parents
          *  Returns a map where the key is the variable name, and the value is the sampled state of the variable
          *  Returns a weight representing the likelihood that the event accords to the evidence
+         *  Throws std::invalid_argument if a node or a state of the evidence is unknown
          */
         std::tuple<std::unordered_map<std::string,std::string>, float> weighted_sample(const std::unordered_map<std::string, std::string>& evidence);
 
+        // sets the number of worker threads used by the sampling algorithms (at least 1): unless it is the size of its pool,
+        // the graph leaves it for a pool of its own. Must not be called while an inference (or an asynchronous query) is running
+        void set_num_threads(int num_threads);
+
+        // returns the number of worker threads used by the sampling algorithms
+        int get_num_threads() const;
+
+        // returns a snapshot of the hot-path counters (all zeros if the library is built without BAYNET_ENABLE_STATS)
+        Stats stats() const;
+
+        // sets all the counters to zero
+        void reset_stats();
+
+        // enables or disables the rounding of the returned probabilities to two decimals (enabled by default)
+        void set_rounding(bool enabled);
+
+        // list of all the network nodes in topological order.
+        // In a lazy graph the cpt of a node is null until it has been used
+        std::vector<Node> node_list;
+
+        // given the node name it returns the index for node_list, -1 if there is no such node
+        int get_node_index(std::string_view name) const;
+
+        // returns the ids of the nodes of the file that are not in node_list, in file order: the nodes of unsupported types
+        // and the ones that depend on them (see LoadOptions::skip_unsupported_nodes)
+        const std::vector<std::string>& skipped_nodes() const;
+
+        // returns a read-only view of the node with the given index in node_list, which copies nothing
+        NodeView view(int index) const;
+
+        // returns a read-only view of the node with the given name. Throws std::invalid_argument if there is no such node
+        NodeView view(std::string_view name) const;
+
+    private:
+        // location of the cpt of a node in the mapped file
+        struct CptSource {
+            std::string_view type; // "cpt", "deterministic" or "noisymax"
+            std::string_view body;
+            std::string_view strengths; // only for noisymax nodes
+            size_t n_rows; // number of configurations of the parents
+        };
+
+        // parses the cpt of a node from its source. Throws std::runtime_error if it is malformed
+        std::shared_ptr<std::vector<std::vector<float>>> parse_cpt(int index) const;
+
+        // parses the resulting states of a deterministic node from its source. Throws std::runtime_error if they are malformed
+        std::shared_ptr<const ResultingStates> parse_resulting_states(int index) const;
+
+        // parses the link parameters of a noisy-MAX node from its source. Throws std::runtime_error if they are malformed
+        std::shared_ptr<const NoisyMax> parse_noisy_max(int index) const;
+
+        // parses the cpt (or the resulting states) of a node of a lazy graph if it has not been loaded yet (it does nothing for the other graphs)
+        void load_cpt(int index);
+
+        // loads the cpts of the relevant nodes of a lazy graph, in parallel
+        void load_cpts(const std::vector<bool>& relevant);
+
+        // replaces the cpt of a node (loaded) with probabilities, whose text hashes to hashed_cpt, in the storage of the graph.
+        // A deterministic or noisy-MAX node becomes a regular one
+        void install_cpt(int index, std::vector<std::vector<float>> probabilities, const std::string& hashed_cpt);
+
+        // returns the node of each column of a dataset (-1 for the columns that are not nodes).
+        // Throws std::runtime_error if a node has more than one column, or none and all_nodes_required is set
+        std::vector<int> dataset_columns(const std::vector<std::string_view>& columns, bool all_nodes_required) const;
+
+        // returns the state of a node written in a field of a dataset (its name or its index), -1 if the field is empty or "?".
+        // Throws std::runtime_error if the state is unknown
+        int parse_state(int index, std::string_view field) const;
+
+        // replaces the cpt of a node with the relative frequencies of counts (its rows one after the other), smoothed with the prior
+        void install_counts(int index, const double* counts, const LearnOptions& options);
+
+        // nodes without a value in the cases with the same missing values, shared by them in the E-step
+        struct MissingPattern {
+            std::vector<int> hidden; // nodes without a value
+            std::vector<int> families; // nodes whose family (the node and its parents) has a hidden node
+            std::vector<std::vector<int>> family_hidden; // hidden nodes of each family, only if joint is not set
+            bool joint; // the joint table of all the hidden nodes is small: one query for each case instead of one for each family
+        };
+
         /*
-         * Performs approximate inference on a query variable using the rejection sampling algorithm
-         * Returns a vector containing the conditional probabilities of the query variable
+         * Adds count times the expected counts of a case (evidence has the state of each node, -1 for the hidden ones) to counts,
+         * laid out like in learn_parameters, and returns P(evidence). algorithm is the engine of learn_parameters_em.
+         * Only reads the graph, so the workers can run it at once once the cpts are loaded
+         */
+        double expected_counts(const std::vector<int>& evidence, double count, const MissingPattern& pattern, int algorithm,
+                               int num_samples, const std::vector<size_t>& offsets, std::vector<double>& counts,
+                               std::default_random_engine& engine);
+
+        static constexpr size_t max_em_joint_states = 1 << 12; // larger joint tables of the hidden nodes are split into families
+
+        // returns the number of rows of the cpt of a node: the number of configurations of its parents
+        size_t cpt_rows(int index) const;
+
+        // clears node_list and drops from the cpt store the cpts that only this graph used
+        void release_cpts();
+
+        /*
+         * Returns the nodes that can influence the targets: the targets and their ancestors.
+         * The other nodes sum out to 1 and can be skipped by all the algorithms
+         */
+        std::vector<bool> relevant_nodes(const std::vector<int>& targets);
+
+        /*
+         * Samples the relevant nodes in topological order, writing the index of the state of each one in states
+         * (a state for each node of node_list, the other nodes are left untouched). Their cpts must be loaded.
+         * Nothing is allocated, so the workers can reuse states for all their samples
+         */
+        void sample_states(std::vector<int>& states, const std::vector<bool>& relevant, std::default_random_engine& engine) const;
+
+        /*
+         * Like sample_states, but the nodes with evidence (a state index in evidence, -1 for the other nodes) are not sampled:
+         * their state is set to the evidence. Returns the likelihood of the evidence given the sampled states of the parents
+         */
+        float weighted_states(std::vector<int>& states, const std::vector<int>& evidence, const std::vector<bool>& relevant,
+                              std::default_random_engine& engine) const;
+
+        // returns P(states[index] | states of its parents), states has a state for each node of node_list. The cpt must be loaded
+        double family_probability(int index, const std::vector<int>& states) const;
+
+        // returns P(state | row of the parents) of a node, like family_probability. The cpt must be loaded
+        double row_probability(int index, size_t row, int state) const;
+
+        // returns the factors of the relevant nodes (see node_factors) reduced with the evidence. Their cpts must be loaded
+        std::vector<Factor> reduced_factors(const std::vector<bool>& relevant, const std::vector<int>& evidence_states, int& next_aux);
+
+        // returns the exact MAP of the nodes (see maximum_a_posteriori), computed on the relevant nodes only
+        Explanation exact_map(const std::vector<int>& nodes, const std::vector<int>& evidence_states, const std::vector<bool>& relevant);
+
+        // converts the states of all the nodes into a map where the key is the variable name and the value is the state name
+        std::unordered_map<std::string,std::string> states_to_map(const std::vector<int>& states) const;
+
+        /*
+         *  Generates a random state for a node according to its probability distribution, given as n prefix sums.
+         *  Return the index of the state
          */
-        std::vector<float> rejection_sampling(const std::string& query, int num_samples);
+        static int generate_sample(const float* cumulative, size_t n, std::default_random_engine& engine);
+
+        // returns the evidence as the state of each node (-1 for the nodes without evidence). Throws std::invalid_argument if an id is out of range
+        std::vector<int> evidence_states(std::span<const EvidenceItem> evidence) const;
+
+        /*
+         * Performs approximate inference on a query variable using the rejection sampling algorithm.
+         * evidence_states has the state of each evidence node, -1 for the other nodes
+         * Returns the conditional probabilities of the query variable. control (if not null) can stop the sampling early
+         */
+        QueryResult rejection_sampling(const std::vector<int>& query, const std::vector<int>& evidence_states, int num_samples,
+                                       const QueryControl* control);
 
         /*
         * Performs approximate inference on a query variable using the likelihood weighting algorithm
-        * Returns a vector containing the conditional probabilities of the query variable
+        * Returns the conditional probabilities of the query variable. control (if not null) can stop the sampling early
         */
-        std::vector<float> likelihood_weighting(const std::string& query, int num_samples);
+        QueryResult likelihood_weighting(const std::vector<int>& query, const std::vector<int>& evidence_states, int num_samples,
+                                         const QueryControl* control);
 
         // Estimates prior probability of each variable in the network (so without any evidence set) by generating num_samples events
-        std::vector<float> forward_sampling(const std::string &query, int num_samples);
+        QueryResult forward_sampling(const std::vector<int>& query, int num_samples, const QueryControl* control);
+
+        /*
+         * Performs exact inference on a query variable using the variable elimination algorithm.
+         * Only the ancestors of the query and of the evidence variables are taken into account
+         * Returns a vector containing the conditional probabilities of the query variable
+         */
+        std::vector<float> variable_elimination(const std::vector<int>& query, const std::vector<int>& evidence_states);
+
+        // returns the joint table of the query nodes and the evidence, P(query, evidence), not normalised: its sum is P(evidence).
+        // Laid out like the joint queries. It only reads the graph, so several workers can call it at once once the cpts are loaded
+        std::vector<double> joint_table(const std::vector<int>& query, const std::vector<int>& evidence_states);
+
+        /*
+         * Splits num_samples in n_threads tasks of the pool, each one running t_fun(number of samples, random engine).
+         * Every task gets its own engine, seeded from gen, so the workers never share one.
+         * With a control, the tasks call t_fun on chunks of control_chunk samples and stop when it requests so
+         * (but the first chunk of the first task is always drawn).
+         * Returns the element-wise sum of the vectors returned by the workers (in double, so that the counts and the weights of
+         * many samples do not lose precision), and the number of samples drawn
+         */
+        std::vector<double> run_workers(int num_samples, size_t n_states,
+                                        const std::function<std::vector<double>(int, std::default_random_engine&)>& t_fun,
+                                        const QueryControl* control, int& samples_used);
+
+        // runs a (joint) query over valid, distinct nodes. control can be null (see single_node_inference)
+        QueryResult run_query(const std::vector<int>& query, std::span<const EvidenceItem> evidence, int num_samples, int algorithm,
+                              const QueryControl* control);
+
+        // throws std::invalid_argument if algorithm is not one of the ids of single_node_inference
+        static void check_algorithm(int algorithm);
+
+        // checks the nodes of a joint query. Throws std::invalid_argument if one is out of range or repeated, or if the table is too large
+        std::vector<int> joint_query(std::span<const NodeId> query) const;
+
+        // computes the strides of the query nodes in the joint table (the last one changes fastest), returns the number of joint states
+        size_t joint_strides(const std::vector<int>& query, std::vector<size_t>& strides) const;
+
+        // returns the index in the joint table of the states of the query nodes (states has a state for each node)
+        static inline size_t joint_index(const std::vector<int>& states, const std::vector<int>& query, const std::vector<size_t>& strides) {
+            size_t index = 0;
+            for (size_t k = 0; k < query.size(); k++)
+                index += (size_t) states[query[k]] * strides[k];
+            return index;
+        }
+
+        static constexpr size_t max_joint_states = 1 << 24; // joint tables are dense: larger ones are rejected
+
+        static constexpr size_t score_block = 1024; // rows scored by a task of score_rows
+
+        static constexpr size_t max_score_table = 1 << 20; // larger log cpts are not tabulated by score_rows
+
+        static constexpr int control_chunk = 256; // samples drawn between two checks of the QueryControl
+
+        /*
+         * Returns the factors of a node: its cpt, defined over the node and its parents.
+         * A noisy-MAX node is decomposed into a chain of small factors, one for each parent, linked by auxiliary
+         * variables that get the indexes from next_aux on (next_aux is advanced past them)
+         */
+        std::vector<Factor> node_factors(int index, int& next_aux);
+
+        // splits a query in the form "VarName|Var1=StateX,..." into the query node and the evidence.
+        // Throws std::invalid_argument if a node or a state are unknown
+        std::pair<NodeId, std::vector<EvidenceItem>> resolve_query(const std::string& query) const;
+
+        // runs single_node_inference on every node with the same evidence. Throws std::invalid_argument if the evidence is invalid
+        std::unordered_map<std::string, std::vector<float>> all_nodes_inference(int num_samples, const std::string& evidence, int algorithm);
+
+        // queues an asynchronous query on pool, counted in pending_queries until it ends
+        template <typename F>
+        auto submit_query(F query) -> std::future<std::invoke_result_t<F&>>;
+
+        std::default_random_engine gen; // random number generator, it only seeds the engines of the workers
+
+        std::mutex gen_mutex; // serialises the uses of gen, since queries can run concurrently on the pool
+
+        int n_threads; // number of workers used for loading and sampling
+
+        std::shared_ptr<ThreadPool> pool; // n_threads workers, usually shared with the other graphs
+
+        int pending_queries = 0; // asynchronous queries queued or running, waited for by the destructor
+
+        std::mutex queries_mutex; // protects pending_queries
+
+        std::condition_variable queries_done; // notified when pending_queries drops to 0
+
+        bool round_results = true; // round the returned probabilities to two decimals
+
+        std::vector<bool> all_nodes; // relevance mask selecting every node
+
+        std::unique_ptr<MappedFile> file; // kept only by lazy graphs, cpt_sources point into it
+
+        std::vector<CptSource> cpt_sources; // kept only by lazy graphs
+
+        std::unique_ptr<std::once_flag[]> cpt_once; // one flag for each node, null if the graph is not lazy
+
+        std::unique_ptr<std::atomic<bool>[]> cpt_loaded; // set once the cpt of the node has been loaded
+
+        CptStorage cpt_storage;
+
+        std::unique_ptr<SymbolTable> symbols; // names of the nodes and of their states, the nodes point to it
+
+        std::vector<int> symbol_nodes; // symbol id, index of the node with that name (-1 for the names of states)
+
+        std::vector<std::string> skipped; // see skipped_nodes
+
+        std::shared_ptr<CptStore> cpt_store; // float cpts, possibly shared with other graphs
+
+        std::unordered_map<std::string, std::shared_ptr<const QuantizedCpt>> quantized_cpts; // hash of the cpt text, quantised cpt (lazy Fixed16 graphs)
 
-        int check_query_validity(const std::string& s);
+        std::mutex quantized_cpts_mutex; // serialises the lazy loads of quantized_cpts, which can run on several workers
 
-        std::default_random_engine gen; // random number generator
+        BAYNET_STATS(mutable StatsCollector stats_collector;)
     };
 
 }
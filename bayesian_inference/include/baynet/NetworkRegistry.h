@@ -0,0 +1,64 @@
+#ifndef BAYESIANNETWORKS_NETWORKREGISTRY_H
+#define BAYESIANNETWORKS_NETWORKREGISTRY_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Graph.h"
+
+namespace baynet {
+    // memory taken by the float cpts of the graphs of a registry
+    struct RegistryMemory {
+        size_t cpt_bytes = 0; // bytes the cpts would take if every graph had its own copy
+        size_t unique_cpt_bytes = 0; // bytes actually taken: each distinct cpt is stored once
+        size_t unique_cpts = 0; // number of distinct cpts
+
+        // bytes saved by the deduplication
+        size_t saved_bytes() const { return cpt_bytes > unique_cpt_bytes ? cpt_bytes - unique_cpt_bytes : 0; }
+    };
+
+    /*
+     * Loads many networks in one process, under names chosen by the caller.
+     * All the graphs share one cpt store: identical float cpts (e.g. of model variants that differ in a few cpts)
+     * are stored once, whatever graph they come from. Each graph can be unloaded on its own, the cpts it shares
+     * with the other graphs stay. All the methods are thread safe
+     */
+    class NetworkRegistry {
+    public:
+        NetworkRegistry();
+
+        NetworkRegistry(const NetworkRegistry& other) = delete;
+        NetworkRegistry& operator=(const NetworkRegistry& other) = delete;
+
+        // loads a network (see the Graph constructor) under the given name and returns it.
+        // Throws std::invalid_argument if the name is already used, std::runtime_error if the file can not be loaded
+        std::shared_ptr<Graph> load(const std::string& name, const std::string& filename, const LoadOptions& options = {});
+
+        // returns the graph with the given name. Throws std::invalid_argument if there is no such graph
+        std::shared_ptr<Graph> get(const std::string& name) const;
+
+        // returns true if a graph with the given name is loaded
+        bool contains(const std::string& name) const;
+
+        // removes the graph from the registry. It is destroyed (and its own cpts released) once the callers
+        // holding it drop it. Throws std::invalid_argument if there is no such graph
+        void unload(const std::string& name);
+
+        // returns the names of the loaded graphs, sorted
+        std::vector<std::string> names() const;
+
+        // returns the memory taken by the float cpts of the loaded graphs, with and without the deduplication
+        RegistryMemory memory() const;
+
+    private:
+        std::shared_ptr<CptStore> store; // shared by all the graphs
+
+        std::unordered_map<std::string, std::shared_ptr<Graph>> graphs; // name, graph
+
+        mutable std::mutex mutex; // protects graphs
+    };
+}
+
+#endif //BAYESIANNETWORKS_NETWORKREGISTRY_H
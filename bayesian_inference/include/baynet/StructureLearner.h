@@ -0,0 +1,112 @@
+#ifndef BAYESIANNETWORKS_STRUCTURELEARNER_H
+#define BAYESIANNETWORKS_STRUCTURELEARNER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Graph.h"
+
+namespace baynet {
+    // score of a structure, the sum of the scores of its families (a node and its parents)
+    enum class StructureScore {
+        BIC, // log-likelihood minus log(cases) / 2 for each free parameter
+        BDeu // log marginal likelihood with a uniform Dirichlet prior of equivalent_sample_size
+    };
+
+    // options of the structure search
+    struct StructureOptions {
+        StructureScore score = StructureScore::BIC;
+        double equivalent_sample_size = 1; // BDeu
+        int max_parents = 3;
+        int max_iterations = 1000; // moves (add, delete or reverse an edge)
+        /*
+         * Tabu search: the edges of the last tabu_size moves can not be changed again, unless the move gives a structure better
+         * than the best one, and the search goes on with the best allowed move even if it lowers the score, for at most
+         * max_no_improvement moves after the best structure. With tabu_size = 0 it is a plain hill climbing,
+         * which stops as soon as no move improves the score
+         */
+        int tabu_size = 20;
+        int max_no_improvement = 10;
+    };
+
+    // result of the structure search
+    struct StructureResult {
+        double score = 0; // score of the best structure, which is the one kept by the learner
+        int iterations = 0; // moves applied
+        size_t cached_families = 0; // family scores computed and cached so far (also by the previous searches)
+    };
+
+    /*
+     * Learns the structure of a network from a CSV file of complete cases: every column is a node, whose states are the distinct
+     * values of the column, sorted. The search starts from the network without edges and applies the best move (add, delete or
+     * reverse an edge) until none improves the score. The score of each family is cached, so after the first moves only
+     * the families of the two nodes of the last move are scored again: the missing ones are counted in parallel, with one
+     * bitmap of the cases for each state, ANDed along the configurations of the parents (the empty branches are pruned).
+     * The learned network is written as an .xdsl file, in topological order, and can be loaded as a Graph
+     */
+    class StructureLearner {
+    public:
+        //reads the dataset (absolute, or relative to the project root).
+        //Throws std::runtime_error if the file can not be read, a value is missing or a column has more than 65535 states
+        explicit StructureLearner(const std::string& csv_path);
+
+        StructureLearner(const StructureLearner& other) = delete;
+        StructureLearner& operator=(const StructureLearner& other) = delete;
+
+        //runs the search from the network without edges. Throws std::invalid_argument if the options are not valid
+        StructureResult learn(const StructureOptions& options = {});
+
+        //returns the parents of every node (indexes of the columns, sorted) in the learned structure
+        const std::vector<std::vector<int>>& get_parents() const;
+
+        //returns the names of the nodes (the columns of the dataset)
+        const std::vector<std::string>& get_names() const;
+
+        //returns the number of cases
+        size_t get_n_cases() const;
+
+        //writes the learned network in an .xdsl file (absolute, or relative to the project root), the cpts are estimated
+        //from the dataset with the given prior (see Graph::learn_parameters). Throws std::invalid_argument if a column name or a value
+        //is not a valid xdsl id (a letter or an underscore, then letters, digits or underscores), std::runtime_error if the file
+        //can not be written
+        void write_xdsl(const std::string& filename, const LearnOptions& options = {}) const;
+
+        //writes the learned network (see write_xdsl, same exceptions) and loads it
+        std::unique_ptr<Graph> make_graph(const std::string& filename, const LearnOptions& options = {},
+                                          const LoadOptions& load_options = {}) const;
+
+        //sets the number of threads that count the families (at least 1), in a pool of the learner instead of the shared one
+        void set_num_threads(int num_threads);
+
+    private:
+        //fills counts with the number of cases of each state of node (last) for each configuration of parents (laid out like a cpt)
+        void count_family(int node, const std::vector<int>& parents, std::vector<uint32_t>& counts) const;
+
+        //returns the score of a family (see StructureScore)
+        double family_score(int node, const std::vector<int>& parents, const StructureOptions& options) const;
+
+        //returns the cached score of a family, which must have been computed
+        double cached_score(int node, const std::vector<int>& parents) const;
+
+        //returns the key of a family in the cache
+        static std::string family_key(int node, const std::vector<int>& parents);
+
+        std::vector<std::string> names; // name of each node
+        std::vector<std::vector<std::string>> states; // names of the states of each node
+        std::vector<std::vector<uint16_t>> data; // state of each case, a column for each node
+        size_t n_cases = 0;
+        size_t n_words = 0; // 64-bit words of a bitmap of the cases
+        std::vector<size_t> bitmap_offsets; // the bitmap of state s of node i starts at bitmaps[(bitmap_offsets[i] + s) * n_words]
+        std::vector<uint64_t> bitmaps; // bit c is set if case c has that state
+
+        std::vector<std::vector<int>> parents; // learned structure
+        std::unordered_map<std::string, double> score_cache; // family key, score
+        StructureScore cache_score = StructureScore::BIC; // score of the cached families
+        double cache_sample_size = 1;
+        std::shared_ptr<ThreadPool> pool; // ThreadPool::shared unless set_num_threads was called
+    };
+}
+
+#endif //BAYESIANNETWORKS_STRUCTURELEARNER_H
@@ -16,6 +16,9 @@ public:
     //function to get the value of the shared_ptr
     T value() const {return *m_ptr;}
 
+    //function to read the value of the shared_ptr without copying it (null if there is none)
+    const T* get() const {return m_ptr.get();}
+
     // returns count of the shared_ptr instance
     long use_count() const
     {
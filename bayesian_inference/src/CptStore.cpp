@@ -0,0 +1,66 @@
+#include "CptStore.h"
+
+CptStore::Entry CptStore::find(const std::string& hash) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(hash);
+    return it != entries.end() ? it->second : Entry{};
+}
+
+CptStore::Entry CptStore::insert(const std::string& hash, std::shared_ptr<std::vector<std::vector<float>>> probabilities,
+                                 std::shared_ptr<const CumulativeCpt> cumulative) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(hash);
+        if (it != entries.end())
+            return it->second;
+    }
+    // the prefix sums are compiled outside of the lock; if another graph stored the same cpt meanwhile, its copy is kept
+    if (!cumulative)
+        cumulative = std::make_shared<const CumulativeCpt>(*probabilities);
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.emplace(hash, Entry{std::move(probabilities), std::move(cumulative)}).first->second;
+}
+
+void CptStore::release(const std::string& hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(hash);
+    if (it != entries.end() && it->second.probabilities.use_count() == 1)
+        entries.erase(it);
+}
+
+long CptStore::use_count(const std::string& hash) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(hash);
+    return it != entries.end() ? it->second.probabilities.use_count() : 0;
+}
+
+size_t CptStore::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t CptStore::memory() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (auto& e : entries)
+        bytes += memory(e.second);
+    return bytes;
+}
+
+size_t CptStore::memory(const Entry& entry) {
+    size_t bytes = 0;
+    if (entry.probabilities) {
+        bytes += sizeof(std::vector<std::vector<float>>);
+        for (const auto& row : *entry.probabilities)
+            bytes += sizeof(row) + row.capacity() * sizeof(float);
+    }
+    if (entry.cumulative)
+        bytes += sizeof(CumulativeCpt) + entry.cumulative->get_n_rows() * entry.cumulative->get_n_states() * sizeof(float);
+    return bytes;
+}
+
+void CptStore::for_each(const std::function<void(const std::string&, const Entry&)>& fun) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& e : entries)
+        fun(e.first, e.second);
+}
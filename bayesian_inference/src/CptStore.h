@@ -0,0 +1,56 @@
+#ifndef BAYESIANNETWORKS_CPTSTORE_H
+#define BAYESIANNETWORKS_CPTSTORE_H
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CumulativeCpt.h"
+
+/*
+ * Float cpts shared by the nodes of one or more graphs (CoW): a cpt is stored once under the sha1 hash of its text,
+ * together with its prefix sums, and every node with the same cpt points to the same entry.
+ * An entry is dropped once no node uses it anymore, so a graph can be destroyed while the other graphs of the store
+ * keep their cpts. All the methods are thread safe
+ */
+class CptStore {
+public:
+    struct Entry {
+        std::shared_ptr<std::vector<std::vector<float>>> probabilities; // null if the hash is not stored
+        std::shared_ptr<const CumulativeCpt> cumulative;
+    };
+
+    //returns the entry of the hash, an empty one if it is not stored
+    Entry find(const std::string& hash) const;
+
+    //stores the cpt under the hash if it is not stored yet (computing its prefix sums if not given) and returns the stored entry
+    Entry insert(const std::string& hash, std::shared_ptr<std::vector<std::vector<float>>> probabilities,
+                 std::shared_ptr<const CumulativeCpt> cumulative = nullptr);
+
+    //drops the entry of the hash if no node uses it
+    void release(const std::string& hash);
+
+    //returns the number of references to the cpt of the hash (the nodes using it plus the store), 0 if it is not stored
+    long use_count(const std::string& hash) const;
+
+    //returns the number of stored cpts
+    size_t size() const;
+
+    //returns the bytes taken by the stored cpts and their prefix sums
+    size_t memory() const;
+
+    //returns the bytes taken by a cpt and its prefix sums
+    static size_t memory(const Entry& entry);
+
+    //calls fun for each stored cpt, holding the lock of the store
+    void for_each(const std::function<void(const std::string&, const Entry&)>& fun) const;
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries; // hash of the cpt text, cpt
+};
+
+#endif //BAYESIANNETWORKS_CPTSTORE_H
@@ -0,0 +1,76 @@
+#include "CsvReader.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    std::string_view trim(std::string_view field) {
+        while (!field.empty() && (field.front() == ' ' || field.front() == '\t'))
+            field.remove_prefix(1);
+        while (!field.empty() && (field.back() == ' ' || field.back() == '\t' || field.back() == '\r'))
+            field.remove_suffix(1);
+        return field;
+    }
+
+    // splits a line at the commas, into fields
+    void split_fields(std::string_view line, std::vector<std::string_view>& fields) {
+        fields.clear();
+        while (true) {
+            size_t comma = line.find(',');
+            fields.push_back(trim(line.substr(0, comma)));
+            if (comma == std::string_view::npos)
+                break;
+            line.remove_prefix(comma + 1);
+        }
+    }
+}
+
+csv::Reader::Reader(const std::string& filename) : file(filename) {
+    std::string_view content = file.view();
+    size_t end = content.find('\n');
+    std::string_view header = content.substr(0, end);
+    if (trim(header).empty())
+        throw std::runtime_error("Missing header in " + filename);
+    split_fields(header, columns);
+    cases = end == std::string_view::npos ? std::string_view() : content.substr(end + 1);
+}
+
+const std::vector<std::string_view>& csv::Reader::get_columns() const {
+    return columns;
+}
+
+std::vector<std::string_view> csv::Reader::split(size_t n) const {
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    for (size_t i = 1; i <= n && start < cases.size(); i++) {
+        // every chunk ends at the first line break after its share of the bytes
+        size_t end = i == n ? cases.size() : std::max(start, cases.size() * i / n);
+        if (end < cases.size()) {
+            size_t line_break = cases.find('\n', end);
+            end = line_break == std::string_view::npos ? cases.size() : line_break + 1;
+        }
+        if (end > start)
+            chunks.push_back(cases.substr(start, end - start));
+        start = end;
+    }
+    return chunks;
+}
+
+bool csv::Reader::next(std::string_view& chunk, std::vector<std::string_view>& fields) const {
+    while (!chunk.empty()) {
+        size_t end = chunk.find('\n');
+        std::string_view line = chunk.substr(0, end);
+        chunk.remove_prefix(end == std::string_view::npos ? chunk.size() : end + 1);
+        if (trim(line).empty())
+            continue;
+        split_fields(line, fields);
+        if (fields.size() != columns.size())
+            throw std::runtime_error("Wrong number of fields at line " + std::to_string(line_of(line.data())));
+        return true;
+    }
+    return false;
+}
+
+size_t csv::Reader::line_of(const char* position) const {
+    std::string_view content = file.view();
+    return 1 + std::count(content.data(), position, '\n');
+}
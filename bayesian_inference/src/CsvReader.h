@@ -0,0 +1,43 @@
+#ifndef BAYESIANNETWORKS_CSVREADER_H
+#define BAYESIANNETWORKS_CSVREADER_H
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.h"
+
+//namespace for the reader of .csv datasets
+namespace csv {
+    /*
+     * Reader of a CSV file of cases, mapped in memory.
+     * The first line has the names of the columns, every other non-empty line is a case with a field for each column.
+     * Fields are separated by commas and trimmed of spaces and carriage returns, quoting is not supported.
+     * All the views point into the mapped file, nothing is copied, and the cases can be read by several threads at once
+     */
+    class Reader {
+    public:
+        //maps the file and reads the header. Throws std::runtime_error if the file can not be opened or has no header
+        explicit Reader(const std::string& filename);
+
+        //returns the names of the columns
+        const std::vector<std::string_view>& get_columns() const;
+
+        //splits the cases into at most n chunks of whole lines, of about the same size
+        std::vector<std::string_view> split(size_t n) const;
+
+        //reads the next case of chunk into fields, advancing chunk past it. Returns false at the end of the chunk.
+        //Throws std::runtime_error if the case does not have a field for each column
+        bool next(std::string_view& chunk, std::vector<std::string_view>& fields) const;
+
+        //returns the line (from 1) of a position in the file, for the error messages
+        size_t line_of(const char* position) const;
+
+    private:
+        MappedFile file;
+        std::vector<std::string_view> columns;
+        std::string_view cases; // the lines after the header
+    };
+}
+
+#endif //BAYESIANNETWORKS_CSVREADER_H
@@ -0,0 +1,35 @@
+#include "CumulativeCpt.h"
+
+CumulativeCpt::CumulativeCpt(const std::vector<std::vector<float>>& probabilities)
+    : n_rows(probabilities.size()), n_states(probabilities.empty() ? 1 : probabilities.front().size())
+{
+    values.reserve(n_rows * n_states);
+    for (const auto& row : probabilities) {
+        size_t start = values.size();
+        values.insert(values.end(), row.begin(), row.end());
+        values.resize(start + n_states, 0); // rows are all of the same length, this only guards malformed tables
+        accumulate(values.data() + start, n_states);
+    }
+}
+
+void CumulativeCpt::accumulate(float* row, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += row[i];
+
+    double partial = 0;
+    for (size_t i = 0; i < n; i++) {
+        partial += row[i];
+        row[i] = sum > 0 ? (float) std::min(partial / sum, 1.0) : 1.0f;
+    }
+    if (n > 0)
+        row[n - 1] = 1;
+}
+
+size_t CumulativeCpt::get_n_rows() const {
+    return n_rows;
+}
+
+size_t CumulativeCpt::get_n_states() const {
+    return n_states;
+}
@@ -0,0 +1,58 @@
+#ifndef BAYESIANNETWORKS_CUMULATIVECPT_H
+#define BAYESIANNETWORKS_CUMULATIVECPT_H
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Prefix sums of the rows of a float cpt, compiled once and used by the samplers.
+ * Every row is normalised so that its last entry is exactly 1: a uniform u in [0, 1) always selects a state,
+ * even when the parsed probabilities do not sum to 1. A state is the number of entries of its row not above u,
+ * so states with probability 0 (equal consecutive entries) are never selected.
+ * The prefix sums are only meant for drawing states: the difference of two of them loses a small probability that follows
+ * a large one (1 - 1e-8 and 1 are the same float), so weights and likelihoods are read from the rows of the float cpt
+ */
+class CumulativeCpt {
+public:
+    explicit CumulativeCpt(const std::vector<std::vector<float>>& probabilities);
+
+    //turns n probabilities into normalised prefix sums, in place (the last one is exactly 1)
+    static void accumulate(float* row, size_t n);
+
+    //returns the state selected by u in [0, 1) in a row of n prefix sums
+    static inline int sample(const float* row, size_t n, float u) {
+        int state = 0;
+        if (n <= 16) {
+            // short rows: compare every entry and count, without branches (the loop is vectorised by the compiler)
+            for (size_t i = 0; i < n; i++)
+                state += row[i] <= u;
+        } else {
+            // long rows: branchless binary search of the first entry above u
+            const float* base = row;
+            for (size_t len = n; len > 1; len -= len / 2)
+                base = base[len / 2] <= u ? base + len / 2 : base;
+            state = (int) (base - row) + (*base <= u);
+        }
+        return std::min(state, (int) n - 1); // only reached if u was rounded up to 1
+    }
+
+    //returns the state selected by u in [0, 1) in a row of the cpt
+    inline int sample(size_t row, float u) const {
+        return sample(values.data() + row * n_states, n_states, u);
+    }
+
+    //returns the number of rows
+    size_t get_n_rows() const;
+
+    //returns the number of states
+    size_t get_n_states() const;
+
+private:
+    size_t n_rows;
+    size_t n_states;
+    std::vector<float> values; // n_states prefix sums for each row
+};
+
+#endif //BAYESIANNETWORKS_CUMULATIVECPT_H
@@ -0,0 +1,317 @@
+#include "Factor.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+    // strides of the variables of f, row-major
+    std::vector<size_t> strides_of(const Factor& f) {
+        std::vector<size_t> strides(f.vars.size());
+        size_t stride = 1;
+        for (int i = (int) f.vars.size() - 1; i >= 0; i--) {
+            strides[i] = stride;
+            stride *= f.cards[i];
+        }
+        return strides;
+    }
+
+    // strides in f of the given variables (0 for the variables f does not contain)
+    std::vector<size_t> strides_in(const Factor& f, const std::vector<int>& vars) {
+        std::vector<size_t> own = strides_of(f);
+        std::vector<size_t> strides(vars.size(), 0);
+        for (int i = 0; i < vars.size(); i++) {
+            int pos = f.position(vars[i]);
+            if (pos >= 0)
+                strides[i] = own[pos];
+        }
+        return strides;
+    }
+
+    // iterates over every assignment of the variables with the given cardinalities (last one fastest),
+    // calling fn(index_x, index_y) with the offsets computed from the two sets of strides
+    template <typename F>
+    void for_each_assignment(const std::vector<size_t>& cards, const std::vector<size_t>& sx, const std::vector<size_t>& sy, F fn) {
+        size_t size = 1;
+        for (size_t c : cards)
+            size *= c;
+        std::vector<size_t> assignment(cards.size(), 0);
+        size_t ix = 0, iy = 0;
+        for (size_t i = 0; i < size; i++) {
+            fn(ix, iy);
+            for (int k = (int) cards.size() - 1; k >= 0; k--) {
+                assignment[k]++;
+                ix += sx[k];
+                iy += sy[k];
+                if (assignment[k] < cards[k])
+                    break;
+                ix -= sx[k] * cards[k];
+                iy -= sy[k] * cards[k];
+                assignment[k] = 0;
+            }
+        }
+    }
+}
+
+Factor::Factor() : values(1, 1.0) {}
+
+Factor::Factor(std::vector<int> vars, std::vector<size_t> cards, double value)
+    : vars(std::move(vars)), cards(std::move(cards)) {
+    size_t size = 1;
+    for (size_t c : this->cards)
+        size *= c;
+    values.assign(size, value);
+}
+
+Factor Factor::from_table(const std::vector<int>& vars, const std::vector<size_t>& cards, const std::vector<double>& table) {
+    std::vector<int> sorted_vars = vars;
+    std::sort(sorted_vars.begin(), sorted_vars.end());
+    std::vector<size_t> sorted_cards;
+    for (int v : sorted_vars)
+        sorted_cards.push_back(cards[std::find(vars.begin(), vars.end(), v) - vars.begin()]);
+
+    Factor result(sorted_vars, sorted_cards);
+    std::vector<size_t> sr = strides_in(result, vars);
+    size_t n = 0;
+    for_each_assignment(cards, sr, sr, [&](size_t ir, size_t) {
+        result.values[ir] = table[n++];
+    });
+    return result;
+}
+
+std::vector<double> Factor::table(const std::vector<int>& order) const {
+    std::vector<size_t> order_cards;
+    for (int v : order)
+        order_cards.push_back(cards[position(v)]);
+
+    std::vector<double> result;
+    result.reserve(values.size());
+    std::vector<size_t> st = strides_in(*this, order);
+    for_each_assignment(order_cards, st, st, [&](size_t it, size_t) {
+        result.push_back(values[it]);
+    });
+    return result;
+}
+
+int Factor::position(int var) const {
+    auto it = std::lower_bound(vars.begin(), vars.end(), var);
+    if (it == vars.end() || *it != var)
+        return -1;
+    return (int) (it - vars.begin());
+}
+
+Factor Factor::product(const Factor& a, const Factor& b) {
+    std::vector<int> vars;
+    std::vector<size_t> cards;
+    int i = 0, j = 0;
+    while (i < a.vars.size() || j < b.vars.size()) {
+        if (j == b.vars.size() || (i < a.vars.size() && a.vars[i] < b.vars[j])) {
+            vars.push_back(a.vars[i]);
+            cards.push_back(a.cards[i++]);
+        } else {
+            if (i < a.vars.size() && a.vars[i] == b.vars[j])
+                i++;
+            vars.push_back(b.vars[j]);
+            cards.push_back(b.cards[j++]);
+        }
+    }
+
+    Factor result(vars, cards);
+    std::vector<size_t> sa = strides_in(a, vars);
+    std::vector<size_t> sb = strides_in(b, vars);
+    size_t n = 0;
+    for_each_assignment(cards, sa, sb, [&](size_t ia, size_t ib) {
+        result.values[n++] = a.values[ia] * b.values[ib];
+    });
+    return result;
+}
+
+Factor Factor::sum_out(int var) const {
+    int pos = position(var);
+    if (pos < 0)
+        return *this;
+
+    std::vector<int> r_vars = vars;
+    std::vector<size_t> r_cards = cards;
+    r_vars.erase(r_vars.begin() + pos);
+    r_cards.erase(r_cards.begin() + pos);
+    Factor result(r_vars, r_cards);
+
+    // iterate over this factor, the summed out variable has stride 0 in the result
+    std::vector<size_t> sr = strides_in(result, vars);
+    size_t n = 0;
+    for_each_assignment(cards, sr, sr, [&](size_t ir, size_t) {
+        result.values[ir] += values[n++];
+    });
+    return result;
+}
+
+Factor Factor::max_out(int var, Factor* best) const {
+    int pos = position(var);
+    if (pos < 0)
+        return *this;
+
+    std::vector<int> r_vars = vars;
+    std::vector<size_t> r_cards = cards;
+    r_vars.erase(r_vars.begin() + pos);
+    r_cards.erase(r_cards.begin() + pos);
+    Factor result(r_vars, r_cards, -1);
+    if (best)
+        *best = Factor(r_vars, r_cards);
+
+    // like sum_out, the entries of var are visited in ascending order of state, so ties keep the first state
+    std::vector<size_t> sr = strides_in(result, vars);
+    size_t stride = strides_of(*this)[pos];
+    size_t n = 0;
+    for_each_assignment(cards, sr, sr, [&](size_t ir, size_t) {
+        if (values[n] > result.values[ir]) {
+            result.values[ir] = values[n];
+            if (best)
+                best->values[ir] = (double) ((n / stride) % cards[pos]);
+        }
+        n++;
+    });
+    return result;
+}
+
+double Factor::value_at(const std::vector<int>& states) const {
+    std::vector<size_t> strides = strides_of(*this);
+    size_t index = 0;
+    for (int i = 0; i < vars.size(); i++)
+        index += (size_t) states[vars[i]] * strides[i];
+    return values[index];
+}
+
+Factor Factor::reduce(int var, int state) const {
+    int pos = position(var);
+    if (pos < 0)
+        return *this;
+
+    std::vector<int> r_vars = vars;
+    std::vector<size_t> r_cards = cards;
+    r_vars.erase(r_vars.begin() + pos);
+    r_cards.erase(r_cards.begin() + pos);
+    Factor result(r_vars, r_cards);
+
+    size_t offset = state * strides_of(*this)[pos];
+    std::vector<size_t> st = strides_in(*this, r_vars);
+    size_t n = 0;
+    for_each_assignment(r_cards, st, st, [&](size_t it, size_t) {
+        result.values[n++] = values[offset + it];
+    });
+    return result;
+}
+
+double Factor::total() const {
+    double sum = 0;
+    for (double v : values)
+        sum += v;
+    return sum;
+}
+
+namespace {
+    // returns the position in candidates of the variable whose elimination creates the smallest factor
+    int cheapest_variable(const std::vector<Factor>& factors, const std::vector<int>& candidates) {
+        int best = 0;
+        double best_size = std::numeric_limits<double>::infinity();
+        for (int k = 0; k < candidates.size(); k++) {
+            std::vector<int> scope;
+            double size = 1;
+            for (const Factor& f : factors) {
+                if (f.position(candidates[k]) < 0)
+                    continue;
+                for (int i = 0; i < f.vars.size(); i++) {
+                    if (std::find(scope.begin(), scope.end(), f.vars[i]) == scope.end()) {
+                        scope.push_back(f.vars[i]);
+                        size *= (double) f.cards[i];
+                    }
+                }
+            }
+            if (size < best_size) {
+                best_size = size;
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    // multiplies all the factors that contain var and removes them from factors, leaving the others
+    Factor take_product(std::vector<Factor>& factors, int var) {
+        Factor joint;
+        std::vector<Factor> others;
+        for (Factor& f : factors) {
+            if (f.position(var) >= 0)
+                joint = Factor::product(joint, f);
+            else
+                others.push_back(std::move(f));
+        }
+        factors = std::move(others);
+        return joint;
+    }
+
+    // returns the variables of the factors that are not contained in keep
+    std::vector<int> variables_not_in(const std::vector<Factor>& factors, const std::vector<int>& keep) {
+        std::vector<int> vars;
+        for (const Factor& f : factors)
+            for (int v : f.vars)
+                if (std::find(keep.begin(), keep.end(), v) == keep.end() && std::find(vars.begin(), vars.end(), v) == vars.end())
+                    vars.push_back(v);
+        return vars;
+    }
+
+    // sums out the variables greedily (see eliminate)
+    void sum_out_all(std::vector<Factor>& factors, std::vector<int> to_eliminate) {
+        while (!to_eliminate.empty()) {
+            int best = cheapest_variable(factors, to_eliminate);
+            int var = to_eliminate[best];
+            to_eliminate.erase(to_eliminate.begin() + best);
+            Factor joint = take_product(factors, var);
+            factors.push_back(joint.sum_out(var));
+        }
+    }
+}
+
+Factor eliminate(std::vector<Factor> factors, const std::vector<int>& keep) {
+    sum_out_all(factors, variables_not_in(factors, keep));
+
+    Factor result;
+    for (const Factor& f : factors)
+        result = Factor::product(result, f);
+    return result;
+}
+
+double max_product_eliminate(std::vector<Factor> factors, const std::vector<int>& maximize, std::vector<int>& best_states) {
+    // summing out first and maximising later gives the exact MAP (the two operations do not commute)
+    sum_out_all(factors, variables_not_in(factors, maximize));
+
+    std::vector<int> to_maximize = variables_not_in(factors, {});
+    std::vector<std::pair<int, Factor>> trace; // eliminated variable, its best state given the variables eliminated later
+    double log_scale = 0;
+    while (!to_maximize.empty()) {
+        int best = cheapest_variable(factors, to_maximize);
+        int var = to_maximize[best];
+        to_maximize.erase(to_maximize.begin() + best);
+
+        Factor best_state;
+        Factor joint = take_product(factors, var);
+        Factor maximized = joint.max_out(var, &best_state);
+        // the maximum is kept as a logarithm: long products of probabilities would underflow
+        double max_value = *std::max_element(maximized.values.begin(), maximized.values.end());
+        if (max_value > 0) {
+            for (double& v : maximized.values)
+                v /= max_value;
+            log_scale += std::log(max_value);
+        }
+        factors.push_back(std::move(maximized));
+        trace.emplace_back(var, std::move(best_state));
+    }
+
+    // the best state of the last eliminated variable depends on nothing, then each one depends only on the following ones
+    for (auto it = trace.rbegin(); it != trace.rend(); it++)
+        best_states[it->first] = (int) it->second.value_at(best_states);
+
+    double value = 1;
+    for (const Factor& f : factors)
+        value *= f.values[0];
+    return value > 0 ? std::log(value) + log_scale : -std::numeric_limits<double>::infinity();
+}
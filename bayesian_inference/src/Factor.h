@@ -0,0 +1,71 @@
+#ifndef BAYESIANNETWORKS_FACTOR_H
+#define BAYESIANNETWORKS_FACTOR_H
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/*
+ * Table of non-negative values over a set of discrete variables, used by the exact inference engines.
+ * Variables are identified by their index in Graph::node_list (auxiliary variables, like the ones of the noisy-MAX
+ * decomposition, get indexes past its end) and are kept sorted in ascending order.
+ * Values are stored row-major: the last variable changes fastest.
+ */
+struct Factor {
+    std::vector<int> vars; // node indexes, sorted
+    std::vector<size_t> cards; // number of states of each variable
+    std::vector<double> values;
+
+    //factor with no variables and value 1
+    Factor();
+
+    //factor over the given (sorted) variables, with all the values set to 'value'
+    Factor(std::vector<int> vars, std::vector<size_t> cards, double value = 0);
+
+    //builds a factor from a table whose variables are in any order (last one changes fastest)
+    static Factor from_table(const std::vector<int>& vars, const std::vector<size_t>& cards, const std::vector<double>& table);
+
+    //returns the values laid out with the variables in the given order (last one changes fastest).
+    //order must be a permutation of vars
+    std::vector<double> table(const std::vector<int>& order) const;
+
+    //returns the position of var in vars, -1 if the factor does not contain it
+    int position(int var) const;
+
+    //returns the product of two factors, defined over the union of their variables
+    static Factor product(const Factor& a, const Factor& b);
+
+    //returns the factor with var summed out
+    Factor sum_out(int var) const;
+
+    //returns the factor with var maximised out. If best is not null, it gets a factor over the same variables as the result
+    //whose values are the state of var that gives the maximum
+    Factor max_out(int var, Factor* best = nullptr) const;
+
+    //returns the value of the entry selected by states (the state of each variable, indexed by variable)
+    double value_at(const std::vector<int>& states) const;
+
+    //returns the factor restricted to the entries where var is equal to state (var is removed)
+    Factor reduce(int var, int state) const;
+
+    //returns the sum of all the values
+    double total() const;
+};
+
+/*
+ * Variable elimination: multiplies the factors and sums out every variable not contained in 'keep'.
+ * Variables are eliminated greedily, choosing each time the one that creates the smallest factor.
+ * Returns a factor over the variables of 'keep' that appear in at least one factor.
+ */
+Factor eliminate(std::vector<Factor> factors, const std::vector<int>& keep);
+
+/*
+ * Max-product variable elimination (MAP): sums out the variables not contained in 'maximize', then maximises out the
+ * ones in it, rescaling the intermediate factors to avoid underflows.
+ * Writes the best state of each variable of 'maximize' that appears in the factors into best_states (indexed by variable,
+ * it must be large enough) and returns the log of max over 'maximize' of the sum over the others of the product of the factors:
+ * -infinity if all the products are 0
+ */
+double max_product_eliminate(std::vector<Factor> factors, const std::vector<int>& maximize, std::vector<int>& best_states);
+
+#endif //BAYESIANNETWORKS_FACTOR_H
@@ -4,149 +4,397 @@
 #include <random>
 #include <future>
 #include <stdexcept>
-#include "tinyxml2.h"
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <filesystem>
+#include <functional>
+#include <charconv>
+#include <map>
+#include <unordered_set>
+#include <numeric>
+#include "MappedFile.h"
+#include "XdslReader.h"
+#include "CsvReader.h"
 #include "Utils.hpp"
 
-//Define the static member
-std::unordered_map<std::string, std::shared_ptr<std::vector<std::vector<float>>>> Node::probs_hashmap;
+baynet::Graph::Graph(const std::string &filename, const LoadOptions& options)
+    : Graph(filename, options, std::make_shared<CptStore>())
+{}
 
-baynet::Graph::Graph(const std::string &filename)
+baynet::Graph::Graph(const std::string &filename, const LoadOptions& options, std::shared_ptr<CptStore> store)
+    : cpt_storage(options.cpt_storage), symbols(std::make_unique<SymbolTable>()), cpt_store(std::move(store))
 {
-    tinyxml2::XMLDocument doc;
-    try {
-        tinyxml2::XMLError err_id = doc.LoadFile(("../../" + filename).c_str());
-        if (err_id != 0) {
-            throw std::runtime_error((const char*)(err_id));
+    BAYNET_TRACE_SCOPE("Graph::Graph");
+    pool = options.pool ? options.pool : ThreadPool::shared();
+    n_threads = pool->size();
+
+    // relative paths are resolved from the project root
+    std::string path = std::filesystem::path(filename).is_absolute() ? filename : "../../" + filename;
+    {
+        BAYNET_TRACE_SCOPE("map_file");
+        file = std::make_unique<MappedFile>(path);
+    }
+
+    // 1. read the structure in file order: states and parents of a node depend on the nodes before it.
+    // The cpts are only located here, they are hashed and parsed in parallel later (or on first use by lazy graphs)
+    {
+        BAYNET_TRACE_SCOPE("read_structure");
+        xdsl::Reader reader(file->view());
+        xdsl::NodeDesc desc;
+        std::unordered_set<std::string_view> unsupported; // nodes skipped because they depend on an unsupported node
+        auto report_skipped = [&] { // the nodes of unsupported types read since the last call
+            for (size_t k = skipped.size() - unsupported.size(); k < reader.skipped_nodes().size(); k++)
+                skipped.emplace_back(reader.skipped_nodes()[k]);
+        };
+        while (reader.next(desc)) {
+            report_skipped();
+            std::string node_id(desc.id);
+            if (get_node_index(node_id) >= 0)
+                throw std::runtime_error("Duplicated node " + node_id + ".");
+            if (desc.states.empty())
+                throw std::runtime_error("Node " + node_id + " has no states.");
+            if (desc.body.empty())
+                throw std::runtime_error("Node " + node_id + " has no " + (desc.type == "cpt" ? "probabilities." : desc.type == "deterministic" ? "resulting states." : "parameters."));
+            if (desc.type == "noisymax" && desc.strengths.empty())
+                throw std::runtime_error("Node " + node_id + " has no strengths.");
+
+            // save the states (names shared by several nodes are stored once)
+            std::vector<uint32_t> states;
+            for (std::string_view state : desc.states) {
+                uint32_t id = symbols->intern(state);
+                if (std::find(states.begin(), states.end(), id) != states.end())
+                    throw std::runtime_error("Duplicated state " + std::string(state) + " in node " + node_id + ".");
+                states.push_back(id);
+            }
+
+            // the parents must precede the node in the file
+            std::vector<int> parents;
+            std::vector<unsigned int> parent_wstates;
+            size_t n_rows = 1;
+            std::string_view unsupported_parent;
+            for (std::string_view parent : desc.parents) {
+                int parent_index = get_node_index(parent);
+                if (parent_index < 0) {
+                    const std::vector<std::string_view>& skipped = reader.skipped_nodes();
+                    if (!unsupported.count(parent) && std::find(skipped.begin(), skipped.end(), parent) == skipped.end())
+                        throw std::runtime_error("Unknown parent " + std::string(parent) + " of node " + node_id + ".");
+                    if (!options.skip_unsupported_nodes)
+                        throw std::runtime_error("Node " + node_id + " depends on the unsupported node " + std::string(parent) + ".");
+                    unsupported_parent = parent;
+                    break;
+                }
+                parents.push_back(parent_index);
+                parent_wstates.push_back(node_list[parent_index].get_n_states());
+                n_rows *= parent_wstates.back();
+            }
+            if (!unsupported_parent.empty()) {
+                std::cerr << "Warning: skipping node " << node_id << ", it depends on the unsupported node " << unsupported_parent << "\n";
+                unsupported.insert(desc.id);
+                skipped.push_back(node_id);
+                continue;
+            }
+
+            // calculates parent weight (used for indexing the cpt during inference)
+            for (int i = 0; i < parent_wstates.size(); i++) {
+                unsigned int prod = 1;
+                for (int j = i+1; j < parent_wstates.size(); j++) {
+                    prod *= parent_wstates[j];
+                }
+                parent_wstates[i] = prod;
+            }
+
+            // the cpt is assigned at the end of the loading
+            uint32_t name = symbols->intern(node_id);
+            if (symbol_nodes.size() <= name)
+                symbol_nodes.resize(name + 1, -1);
+            symbol_nodes[name] = (int) node_list.size();
+            Node node(symbols.get(), name, states, nullptr, parents, "", parent_wstates);
+            node_list.push_back(node);
+            cpt_sources.push_back({desc.type, desc.body, desc.strengths, n_rows});
         }
+        report_skipped();
+        symbol_nodes.resize(symbols->size(), -1);
+        symbols->freeze(); // from here on the names are only looked up, also by the workers
+    }
+    all_nodes.assign(node_list.size(), true);
 
-        tinyxml2::XMLElement* root = doc.FirstChildElement("smile")->FirstChildElement("nodes" );
+    if (options.lazy_cpts) {
+        cpt_once = std::make_unique<std::once_flag[]>(node_list.size());
+        cpt_loaded = std::make_unique<std::atomic<bool>[]>(node_list.size());
+        return;
+    }
 
-        // iterate over all the 'nodes' tags
-        for (tinyxml2::XMLElement* e = root->FirstChildElement( ); e != nullptr; e = e->NextSiblingElement()) {
-            if (strcmp(e->Name(), "cpt") == 0 || strcmp(e->Name(), "deterministic") == 0) {
-                const char* node_id;
-                e->QueryStringAttribute("id", &node_id);
+    // 2. hash the cpts in parallel (deterministic and noisy-MAX nodes are not shared through the cpt store)
+    std::vector<std::string> hashes(cpt_sources.size());
+    pool->parallel_for(cpt_sources.size(), [&](size_t i) {
+        if (cpt_sources[i].type != "cpt")
+            return;
+        BAYNET_TRACE_SCOPE("hash_cpt");
+        hashes[i] = Node::hash_fun(cpt_sources[i].body);
+    });
+
+    // 3. only the first node with a cpt not yet in the cpt store parses it, the other ones share it.
+    // Quantised cpts are not shared with the other graphs, so the first node of each cpt always parses it
+    bool quantize = cpt_storage == CptStorage::Fixed16;
+    std::vector<bool> to_parse(cpt_sources.size(), false);
+    std::unordered_map<std::string, size_t> first_owner;
+    for (size_t i = 0; i < cpt_sources.size(); i++) {
+        if (cpt_sources[i].type != "cpt")
+            to_parse[i] = true;
+        else if ((quantize || !cpt_store->find(hashes[i]).probabilities) && first_owner.emplace(hashes[i], i).second)
+            to_parse[i] = true;
+    }
 
-                // save the states
-                std::unordered_map<std::string, int> states_map;
-                std::vector<std::string> states;
+    // 4. parse and validate the cpts, the resulting states and the noisy-MAX parameters in parallel
+    std::vector<std::shared_ptr<std::vector<std::vector<float>>>> cpts(cpt_sources.size());
+    std::vector<std::shared_ptr<const ResultingStates>> resulting(cpt_sources.size());
+    std::vector<std::shared_ptr<const NoisyMax>> noisy(cpt_sources.size());
+    std::vector<std::shared_ptr<const QuantizedCpt>> quantized(cpt_sources.size());
+    std::vector<std::shared_ptr<const CumulativeCpt>> cumulative(cpt_sources.size());
+    pool->parallel_for(cpt_sources.size(), [&](size_t i) {
+        if (!to_parse[i])
+            return;
+        if (cpt_sources[i].type == "cpt" && quantize) {
+            quantized[i] = std::make_shared<const QuantizedCpt>(*parse_cpt((int) i));
+        } else if (cpt_sources[i].type == "cpt") {
+            cpts[i] = parse_cpt((int) i);
+            cumulative[i] = std::make_shared<const CumulativeCpt>(*cpts[i]);
+        } else if (cpt_sources[i].type == "deterministic") {
+            resulting[i] = parse_resulting_states((int) i);
+        } else {
+            noisy[i] = parse_noisy_max((int) i);
+        }
+    });
 
-                for (tinyxml2::XMLElement* state = e->FirstChildElement("state" ); state != nullptr; state = state->NextSiblingElement("state"))
-                {
-                    const char* state_id;
-                    state->QueryStringAttribute("id", &state_id);
-                    states_map[state_id] = (int)states.size();
-                    states.emplace_back(state_id);
-                }
+    // 5. publish the new cpts in the cpt store and assign them to the nodes, which share the prefix sums of the cpt too.
+    // If a cpt is wrong, the ones already published for this graph are released before throwing
+    try {
+        for (size_t i = 0; i < cpt_sources.size(); i++) {
+            if (resulting[i]) {
+                node_list[i].set_resulting_states(resulting[i]);
+                continue;
+            }
+            if (noisy[i]) {
+                node_list[i].set_noisy_max(noisy[i]);
+                continue;
+            }
+            if (quantize) {
+                node_list[i].set_quantized(quantized[first_owner.at(hashes[i])]);
+                continue;
+            }
+            CptStore::Entry entry = to_parse[i] ? CptStore::Entry{cpts[i], cumulative[i]} : cpt_store->find(hashes[i]);
+            if (!entry.probabilities) // released by another graph of the store after step 3
+                entry.probabilities = parse_cpt((int) i);
+            if (utils::calc_cpt_size(*entry.probabilities) != cpt_sources[i].n_rows * node_list[i].get_n_states())
+                throw std::runtime_error("Node " + std::string(node_list[i].get_name()) + ": wrong cpt size.");
+            entry = cpt_store->insert(hashes[i], entry.probabilities, entry.cumulative);
+            node_list[i].set_probabilities(entry.probabilities, hashes[i], entry.cumulative);
+        }
+    } catch (...) {
+        release_cpts();
+        throw;
+    }
 
-                std::vector<std::string> parents;
-                std::vector<unsigned int> parent_wstates;
-                if (e->FirstChildElement("parents") != nullptr) {
-                    const char* parentlist = e->FirstChildElement("parents")->GetText();
-                    for (const std::string& parent : utils::split_string(parentlist, ' ')) {
-                        parents.push_back(parent);
-                        parent_wstates.push_back(node_list[node_indexes[parent]].get_states().size());
-                    }
-                }
+    // the views into the file are no longer needed
+    cpt_sources.clear();
+    file.reset();
+}
 
-                // calculates parent weight (used for indexing the cpt during inference)
-                for (int i = 0; i < parent_wstates.size(); i++) {
-                    unsigned int prod = 1;
-                    for (int j = i+1; j < parent_wstates.size(); j++) {
-                        prod *= parent_wstates[j];
-                    }
-                    parent_wstates[i] = prod;
-                }
+std::shared_ptr<std::vector<std::vector<float>>> baynet::Graph::parse_cpt(int index) const {
+    BAYNET_TRACE_SCOPE("parse_cpt");
+    const CptSource& source = cpt_sources[index];
+    try {
+        return std::make_shared<std::vector<std::vector<float>>>(
+                xdsl::parse_probabilities(source.body, node_list[index].get_n_states(), source.n_rows));
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error("Node " + std::string(node_list[index].get_name()) + ": " + e.what());
+    }
+}
 
-                std::string hashedCPT;
-                if (strcmp(e->Name(), "cpt") == 0) {
-                    // save the probabilities
-                    if (e->FirstChildElement("probabilities") != nullptr) {
-                        std::string problist = e->FirstChildElement("probabilities")->GetText();
-                        int n = 0;
-                        size_t row_length = states.size();
-                        size_t n_rows = utils::word_count(problist) / row_length;
-
-                        //if hash(probabilities) is not in probs_hashmap, then add it,
-                        // else make the probabilities pointer point the one already existing
-                        hashedCPT = Node::hash_fun(problist);
-                        std::vector<std::vector<float>> probabilities(n_rows);
-                        //If the hashmap does not contain the node, then:
-                        if( Node::probs_hashmap.find(hashedCPT) == Node::probs_hashmap.end())
-                        {
-                            for (auto& p : utils::split_string(problist, ' ')) {
-                                probabilities[n / row_length].push_back(std::stof(p));
-                                n++;
-                            }
-                            Node::probs_hashmap[hashedCPT] = std::make_shared<std::vector<std::vector<float>>>(probabilities);
-                        }
-                    }
-                } else if (strcmp(e->Name(), "deterministic") == 0) {
-                    // save the resulting states
-                    if (e->FirstChildElement("resultingstates") != nullptr) {
-                        std::string statelist = e->FirstChildElement("resultingstates")->GetText();
-                        int n_rows = utils::word_count(statelist);
-                        std::vector<std::vector<float>> probabilities(n_rows); // initialize num of rows
-                        int n_states = 0;
-
-                        //if hash(probabilities) is not in probs_hashmap, then add it,
-                        // else make the probabilities pointer point the one already existing
-
-                        hashedCPT = Node::hash_fun(statelist);
-
-                        //If the hashmap does not contain the node, then:
-                        if( Node::probs_hashmap.find(hashedCPT) == Node::probs_hashmap.end())
-                        {
-                            std::vector<std::vector<float>> table;
-                            for (auto& res_state : utils::split_string(statelist, ' ')) {
-                                std::vector<float> row(n_rows, 0);
-                                for (int i = 0; i < states.size(); i++) {
-                                    if (states[i] == res_state) {
-                                        row[i] = 1;
-                                        break;
-                                    }
-                                }
-                                table.push_back(row);
-                            }
-                            Node::probs_hashmap[hashedCPT] = std::make_shared<std::vector<std::vector<float>>>(table);
-                        }
-                    }
-                }
-                //let's create the node and let's assign to it the probabilities added in probs_hashmap.
-                Node node(node_id, states, states_map, Node::probs_hashmap[hashedCPT], parents, hashedCPT, parent_wstates);
-                node_list.push_back(node);
-                node_indexes[node_id] = (int)node_list.size() - 1;
+std::shared_ptr<const ResultingStates> baynet::Graph::parse_resulting_states(int index) const {
+    BAYNET_TRACE_SCOPE("parse_resulting_states");
+    const CptSource& source = cpt_sources[index];
+    const Node& node = node_list[index];
+    try {
+        auto state_index = [&](std::string_view state) { return node.get_state_index(state); };
+        return std::make_shared<const ResultingStates>(xdsl::parse_resulting_states(source.body, state_index, source.n_rows), node.get_n_states());
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error("Node " + std::string(node_list[index].get_name()) + ": " + e.what());
+    }
+}
+
+std::shared_ptr<const NoisyMax> baynet::Graph::parse_noisy_max(int index) const {
+    BAYNET_TRACE_SCOPE("parse_noisy_max");
+    const CptSource& source = cpt_sources[index];
+    const Node& node = node_list[index];
+    std::vector<size_t> parent_cards;
+    size_t total_states = 0;
+    for (int parent : node.get_parents()) {
+        parent_cards.push_back(node_list[parent].get_n_states());
+        total_states += parent_cards.back();
+    }
+    try {
+        // one row of parameters for each state of each parent, plus the leak
+        std::vector<std::vector<float>> parameters = xdsl::parse_probabilities(source.body, node.get_n_states(), total_states + 1);
+        return std::make_shared<const NoisyMax>(node.get_n_states(), parent_cards, xdsl::parse_integers(source.strengths), parameters);
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error("Node " + std::string(node.get_name()) + ": " + e.what());
+    }
+}
+
+void baynet::Graph::load_cpt(int index) {
+    if (!cpt_once)
+        return;
+    std::call_once(cpt_once[index], [&] {
+        BAYNET_TRACE_SCOPE("load_cpt");
+        if (cpt_sources[index].type == "deterministic") {
+            node_list[index].set_resulting_states(parse_resulting_states(index));
+            return;
+        }
+        if (cpt_sources[index].type == "noisymax") {
+            node_list[index].set_noisy_max(parse_noisy_max(index));
+            return;
+        }
+        std::string hash = Node::hash_fun(cpt_sources[index].body);
+        if (cpt_storage == CptStorage::Fixed16) {
+            std::shared_ptr<const QuantizedCpt> quantized;
+            {
+                std::lock_guard<std::mutex> lock(quantized_cpts_mutex);
+                auto it = quantized_cpts.find(hash);
+                if (it != quantized_cpts.end())
+                    quantized = it->second;
+            }
+            if (!quantized) {
+                auto parsed = std::make_shared<const QuantizedCpt>(*parse_cpt(index));
+                std::lock_guard<std::mutex> lock(quantized_cpts_mutex);
+                quantized = quantized_cpts.emplace(hash, parsed).first->second;
             }
+            node_list[index].set_quantized(quantized);
+            return;
         }
+        // parsed outside of the lock of the store; if another node published the same cpt meanwhile, its copy is kept
+        CptStore::Entry entry = cpt_store->find(hash);
+        if (!entry.probabilities)
+            entry.probabilities = parse_cpt(index);
+        if (utils::calc_cpt_size(*entry.probabilities) != cpt_sources[index].n_rows * node_list[index].get_n_states())
+            throw std::runtime_error("Node " + std::string(node_list[index].get_name()) + ": wrong cpt size.");
+        entry = cpt_store->insert(hash, entry.probabilities, entry.cumulative);
+        node_list[index].set_probabilities(entry.probabilities, hash, entry.cumulative);
+    });
+    cpt_loaded[index].store(true, std::memory_order_release);
+}
 
-    } catch (tinyxml2::XMLError err) { // catch error when loading the xdsl file
-        std::cout << "LoadFile failed with errorID: " << err << "\n";
-        exit(-1);
+void baynet::Graph::load_cpts(const std::vector<bool>& relevant) {
+    if (!cpt_once)
+        return;
+    std::vector<int> missing;
+    for (int i = 0; i < node_list.size(); i++)
+        if (relevant[i] && !cpt_loaded[i].load(std::memory_order_acquire))
+            missing.push_back(i);
+    if (!missing.empty())
+        pool->parallel_for(missing.size(), [&](size_t i) { load_cpt(missing[i]); });
+}
+
+std::vector<bool> baynet::Graph::relevant_nodes(const std::vector<int>& targets) {
+    // node_list is in topological order: visiting it backwards, the parents of a relevant node are marked before being visited
+    std::vector<bool> relevant(node_list.size(), false);
+    for (int target : targets)
+        relevant[target] = true;
+    for (int i = (int) node_list.size() - 1; i >= 0; i--) {
+        if (!relevant[i])
+            continue;
+        for (int parent : node_list[i].get_parents())
+            relevant[parent] = true;
     }
+    return relevant;
 }
 
 baynet::Graph::~Graph(){
-    Node::probs_hashmap.clear();
+    // the queued queries still use the graph: they are completed before anything is released
+    std::unique_lock<std::mutex> lock(queries_mutex);
+    queries_done.wait(lock, [this] { return pending_queries == 0; });
+    lock.unlock();
+    release_cpts();
 };
 
+void baynet::Graph::release_cpts() {
+    // the cpts that are not used by the other graphs of the store are dropped, once the nodes no longer point to them
+    std::vector<std::string> hashes;
+    for (const Node& node : node_list)
+        if (!node.get_hashed_cpt().empty())
+            hashes.push_back(node.get_hashed_cpt());
+    node_list.clear();
+    for (const std::string& hash : hashes)
+        cpt_store->release(hash);
+}
+
 void baynet::Graph::print_node(const std::string& name){
-    const auto & n = node_list[node_indexes[name]];
+    int index = get_node_index(name);
+    if (index < 0)
+        return;
+    load_cpt(index);
+    const auto & n = node_list[index];
     std::cout << "----------Node: " << n.get_name() << "----------" << std::endl;
     std::cout<<"Parents: ";
 
-    for(auto& par : n.get_parents()) std::cout << par << " ";
+    for(int par : n.get_parents()) std::cout << node_list[par].get_name() << " ";
     std::cout<<std::endl;
 
     std::cout<<"States: ";
-    for(auto& st : n.get_states()) std::cout << st << " ";
+    for(int st = 0; st < n.get_n_states(); st++) std::cout << n.get_state(st) << " ";
     std::cout<<std::endl;
 
+    if (n.is_deterministic()) {
+        std::cout<<"Resulting states:";
+        const ResultingStates& resulting = n.get_resulting_states();
+        for (size_t row = 0; row < resulting.size(); row++)
+            std::cout << " " << n.get_state(resulting[row]);
+        std::cout << std::endl;
+        std::cout<<"-------------------------"<< std::endl;
+        return;
+    }
+
+    if (n.is_noisy_max()) {
+        // link parameters of each parent state, then the leak
+        const NoisyMax& noisy = n.get_noisy_max();
+        std::cout<<"Noisy-MAX parameters:";
+        for (int i = 0; i < n.get_parents().size(); i++) {
+            const Node& parent = node_list[n.get_parents()[i]];
+            for (int x = 0; x < parent.get_n_states(); x++) {
+                std::cout << std::endl << parent.get_name() << "=" << parent.get_state(x) << ": ";
+                for (int y = 0; y < noisy.get_n_states(); y++)
+                    std::cout << noisy.link(i, x, y) << " ";
+            }
+        }
+        std::cout << std::endl << "Leak: ";
+        for (int y = 0; y < noisy.get_n_states(); y++)
+            std::cout << noisy.leak(y) << " ";
+        std::cout << std::endl;
+        std::cout<<"-------------------------"<< std::endl;
+        return;
+    }
+
+    if (n.is_quantized()) {
+        const QuantizedCpt& quantized = n.get_quantized();
+        std::cout<<"Quantised CPT:";
+        for (size_t row = 0; row < quantized.get_n_rows(); row++) {
+            std::cout<<std::endl;
+            for (int s = 0; s < quantized.get_n_states(); s++)
+                std::cout << quantized.probability(row, s) << " ";
+            std::cout << std::endl;
+        }
+        std::cout<<"-------------------------"<< std::endl;
+        return;
+    }
+
     std::cout << "Hashed CPT: " << n.get_hashed_cpt() << std::endl;
 
 
     std::cout<<"CPT count: "<<n.use_count()<<std::endl;
     std::cout<<"CPT:";
-    for (const auto& row : n.value()) {
+    for (const auto& row : view(index).cpt()) {
         std::cout<<std::endl;
         for (auto& el : row) {
             std::cout << el << " ";
@@ -158,293 +406,1485 @@ void baynet::Graph::print_node(const std::string& name){
 
 
 void baynet::Graph::edit_cpt(const std::string &name, const std::string &problist) {
-    for (auto& node : node_list) {
-        if (node.get_name() == name) {
-            size_t cpt_size = utils::calc_cpt_size(*node.raw());
-            if (cpt_size == utils::word_count(problist)) { // the size of the probability list must be the same as the cpt size
-                int n = 0;
-                size_t row_length = node.get_states().size();
-                size_t n_rows = cpt_size / row_length;
-                std::vector<std::vector<float>> probabilities(n_rows);
-                for (auto& p : utils::split_string(problist, ' ')) {
-                    probabilities[n / row_length].push_back(std::stof(p));
-                    n++;
-                }
-                std::string oldHash = node.get_hashed_cpt(); // retrieve hashedCPT before modifying it
-                std::string hashedCPT = Node::hash_fun(problist);
-                if( Node::probs_hashmap.find(hashedCPT) == Node::probs_hashmap.end()) {
-                    Node::probs_hashmap[hashedCPT] = std::make_shared<std::vector<std::vector<float>>>(probabilities);
-                }
-                node.set_probabilities(Node::probs_hashmap[hashedCPT], hashedCPT);
-                Node::probs_check_delete(oldHash);
-            }
-            break;
+    BAYNET_TRACE_SCOPE("edit_cpt");
+    int index = get_node_index(name);
+    if (index < 0)
+        return;
+    load_cpt(index); // the size of the new cpt is checked against the current one
+    Node& node = node_list[index];
+    size_t cpt_size;
+    if (node.is_deterministic())
+        cpt_size = node.get_resulting_states().size() * node.get_n_states();
+    else if (node.is_noisy_max())
+        cpt_size = node.get_noisy_max().n_rows() * node.get_n_states();
+    else if (node.is_quantized())
+        cpt_size = node.get_quantized().get_n_rows() * node.get_n_states();
+    else
+        cpt_size = utils::calc_cpt_size(*node.raw());
+    if (cpt_size == utils::word_count(problist)) { // the size of the probability list must be the same as the cpt size
+        int n = 0;
+        size_t row_length = node.get_n_states();
+        size_t n_rows = cpt_size / row_length;
+        std::vector<std::vector<float>> probabilities(n_rows);
+        for (auto& p : utils::split_string(problist, ' ')) {
+            probabilities[n / row_length].push_back(std::stof(p));
+            n++;
         }
+        install_cpt(index, std::move(probabilities), Node::hash_fun(problist));
+    }
+}
+
+void baynet::Graph::install_cpt(int index, std::vector<std::vector<float>> probabilities, const std::string& hashed_cpt) {
+    Node& node = node_list[index];
+    std::string oldHash = node.get_hashed_cpt(); // retrieve hashedCPT before modifying it
+    if (cpt_storage == CptStorage::Fixed16) {
+        node.set_quantized(std::make_shared<const QuantizedCpt>(probabilities));
+    } else {
+        CptStore::Entry entry = cpt_store->find(hashed_cpt);
+        if (!entry.probabilities)
+            entry = cpt_store->insert(hashed_cpt, std::make_shared<std::vector<std::vector<float>>>(std::move(probabilities)));
+        node.set_probabilities(entry.probabilities, hashed_cpt, entry.cumulative); // a deterministic or noisy-MAX node becomes a regular one
     }
+    if (!oldHash.empty())
+        cpt_store->release(oldHash);
 }
 
+size_t baynet::Graph::cpt_rows(int index) const {
+    size_t rows = 1;
+    for (int parent : node_list[index].get_parents())
+        rows *= node_list[parent].get_n_states();
+    return rows;
+}
 
-std::string baynet::Graph::generate_sample(const std::vector<float>& cond_probs, const std::vector<std::string>& states) {
-    std::uniform_real_distribution<float> dis(0,1);
-    float rand = dis(gen); // generate random number [0,1)
-    for (int i = 0; i < cond_probs.size(); i++) { // I know that I have a probability for each state
-        if (rand < cond_probs[i]) {
-            return states[i];
+std::vector<int> baynet::Graph::dataset_columns(const std::vector<std::string_view>& columns, bool all_nodes_required) const {
+    std::vector<int> column_nodes(columns.size(), -1);
+    std::vector<bool> found(node_list.size(), false);
+    for (size_t c = 0; c < columns.size(); c++) {
+        int index = get_node_index(columns[c]);
+        if (index < 0)
+            continue;
+        if (found[index])
+            throw std::runtime_error("Repeated column " + std::string(columns[c]));
+        found[index] = true;
+        column_nodes[c] = index;
+    }
+    if (all_nodes_required)
+        for (int i = 0; i < node_list.size(); i++)
+            if (!found[i])
+                throw std::runtime_error("Missing column for node " + std::string(node_list[i].get_name()));
+    return column_nodes;
+}
+
+int baynet::Graph::parse_state(int index, std::string_view field) const {
+    if (field.empty() || field == "?")
+        return -1;
+    const Node& node = node_list[index];
+    int state = node.get_state_index(field);
+    if (state >= 0)
+        return state;
+    // the states can also be written as indexes
+    auto [end, ec] = std::from_chars(field.data(), field.data() + field.size(), state);
+    if (ec == std::errc() && end == field.data() + field.size() && state >= 0 && state < node.get_n_states())
+        return state;
+    throw std::runtime_error("Unknown state " + std::string(field) + " of node " + std::string(node.get_name()));
+}
+
+void baynet::Graph::install_counts(int index, const double* counts, const LearnOptions& options) {
+    size_t n_states = node_list[index].get_n_states();
+    size_t n_rows = cpt_rows(index);
+    double alpha = 0; // pseudo count of every entry
+    if (options.prior == ParameterPrior::Dirichlet)
+        alpha = options.pseudo_count;
+    else if (options.prior == ParameterPrior::BDeu)
+        alpha = options.equivalent_sample_size / (double) (n_rows * n_states);
+
+    std::vector<std::vector<float>> probabilities(n_rows, std::vector<float>(n_states));
+    std::string text; // hashed like the cpts read from a file
+    for (size_t r = 0; r < n_rows; r++) {
+        const double* row = counts + r * n_states;
+        double sum = 0;
+        for (size_t s = 0; s < n_states; s++)
+            sum += row[s] + alpha;
+        for (size_t s = 0; s < n_states; s++) {
+            probabilities[r][s] = sum > 0 ? (float) ((row[s] + alpha) / sum) : 1.0f / (float) n_states;
+            char buffer[32];
+            auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), probabilities[r][s]);
+            text.append(buffer, end);
+            text += ' ';
         }
-        rand -= cond_probs[i];
     }
-    return {};
+    install_cpt(index, std::move(probabilities), Node::hash_fun(text));
 }
 
+size_t baynet::Graph::learn_parameters(const std::string& csv_path, const LearnOptions& options) {
+    BAYNET_TRACE_SCOPE("learn_parameters");
+    std::string path = std::filesystem::path(csv_path).is_absolute() ? csv_path : "../../" + csv_path;
+    csv::Reader reader(path);
+    std::vector<int> column_nodes = dataset_columns(reader.get_columns(), true);
+    load_cpts(all_nodes); // a lazy graph must not parse them over the learned ones later
+
+    // the counts of all the cpts are kept in one table: state s in row r of node i is at offsets[i] + r * states + s
+    std::vector<size_t> offsets(node_list.size() + 1, 0);
+    for (int i = 0; i < node_list.size(); i++)
+        offsets[i + 1] = offsets[i] + cpt_rows(i) * node_list[i].get_n_states();
+
+    // each worker counts its own part of the file in its own table
+    std::vector<std::string_view> chunks = reader.split(n_threads);
+    std::vector<std::vector<uint64_t>> counts(chunks.size());
+    std::vector<size_t> n_cases(chunks.size(), 0);
+    pool->parallel_for(chunks.size(), [&](size_t c) {
+        BAYNET_TRACE_SCOPE("count");
+        std::vector<uint64_t>& local = counts[c];
+        local.assign(offsets.back(), 0);
+        std::vector<std::string_view> fields;
+        std::vector<int> states(node_list.size(), -1);
+        std::string_view chunk = chunks[c];
+        while (reader.next(chunk, fields)) {
+            for (size_t f = 0; f < fields.size(); f++) {
+                int node = column_nodes[f];
+                if (node < 0)
+                    continue;
+                states[node] = parse_state(node, fields[f]);
+                if (states[node] < 0)
+                    throw std::runtime_error("Missing value at line " + std::to_string(reader.line_of(fields[f].data())));
+            }
+            for (int i = 0; i < node_list.size(); i++)
+                local[offsets[i] + view(i).row(states.data()) * node_list[i].get_n_states() + states[i]]++;
+            n_cases[c]++;
+        }
+    });
+
+    size_t cases = 0;
+    for (size_t n : n_cases)
+        cases += n;
+    if (cases == 0)
+        throw std::runtime_error("No case in " + path); // every cpt would become uniform
+
+    std::vector<uint64_t> total(offsets.back(), 0);
+    for (const std::vector<uint64_t>& local : counts)
+        for (size_t k = 0; k < local.size(); k++)
+            total[k] += local[k];
+
+    std::vector<double> expected(total.begin(), total.end());
+    for (int i = 0; i < node_list.size(); i++)
+        install_counts(i, expected.data() + offsets[i], options);
+    return cases;
+}
 
-std::unordered_map<std::string,std::string> baynet::Graph::prior_sample() {
-    std::unordered_map<std::string,std::string> sample;
 
-    for (auto& node : node_list) {
-        unsigned int states_index = 0;
-        if (!node.get_parents().empty()) { // not a root node
-            // retrieve the index to access the correct probabilities in the CPT given all the parents states (the current evidence)
-            std::vector<unsigned int> parent_weight = node.get_parent_weight_states();
-            for (int i = 0; i < node.get_parents().size(); i++) {
-                states_index += node_list[node_indexes[node.get_parents()[i]]].get_states_map()[sample[node.get_parents()[i]]] * parent_weight[i];
+baynet::EmResult baynet::Graph::learn_parameters_em(const std::string& csv_path, const EmOptions& options) {
+    BAYNET_TRACE_SCOPE("learn_parameters_em");
+    if (options.algorithm != 0 && options.algorithm != 2)
+        throw std::invalid_argument("The E-step runs with likelihood weighting (0) or variable elimination (2)");
+    std::string path = std::filesystem::path(csv_path).is_absolute() ? csv_path : "../../" + csv_path;
+    csv::Reader reader(path);
+    std::vector<int> column_nodes = dataset_columns(reader.get_columns(), false);
+    load_cpts(all_nodes); // the workers of the E-step must find every cpt loaded
+
+    // each worker reads its own part of the file, the nodes without a column stay at -1
+    size_t n_nodes = node_list.size();
+    std::vector<std::string_view> chunks = reader.split(n_threads);
+    std::vector<std::vector<int>> lines(chunks.size());
+    pool->parallel_for(chunks.size(), [&](size_t c) {
+        std::vector<std::string_view> fields;
+        std::string_view chunk = chunks[c];
+        while (reader.next(chunk, fields)) {
+            size_t start = lines[c].size();
+            lines[c].resize(start + n_nodes, -1);
+            for (size_t f = 0; f < fields.size(); f++)
+                if (column_nodes[f] >= 0)
+                    lines[c][start + column_nodes[f]] = parse_state(column_nodes[f], fields[f]);
+        }
+    });
+
+    // identical lines become one case with their number as count, and the cases are grouped by their missing values
+    EmResult result;
+    std::vector<int> cases; // the states of every case, one after the other
+    std::vector<double> case_counts;
+    std::vector<int> case_patterns;
+    std::vector<MissingPattern> patterns;
+    std::unordered_map<std::string, size_t> case_ids; // key: the bytes of the states
+    std::map<std::vector<int>, int> pattern_ids; // key: the hidden nodes
+    for (const std::vector<int>& chunk_lines : lines) {
+        for (size_t start = 0; start < chunk_lines.size(); start += n_nodes) {
+            result.cases++;
+            const int* states = chunk_lines.data() + start;
+            auto [it, inserted] = case_ids.try_emplace(std::string((const char*) states, n_nodes * sizeof(int)), case_counts.size());
+            if (!inserted) {
+                case_counts[it->second]++;
+                continue;
+            }
+            std::vector<int> hidden;
+            for (int i = 0; i < n_nodes; i++)
+                if (states[i] < 0)
+                    hidden.push_back(i);
+            auto [pattern, added] = pattern_ids.try_emplace(hidden, (int) patterns.size());
+            if (added)
+                patterns.push_back({std::move(hidden), {}, {}, false});
+            cases.insert(cases.end(), states, states + n_nodes);
+            case_counts.push_back(1);
+            case_patterns.push_back(pattern->second);
+        }
+    }
+    lines.clear();
+    if (result.cases == 0)
+        throw std::runtime_error("No case in " + path); // the first M-step would make every cpt uniform
+
+    for (MissingPattern& pattern : patterns) {
+        std::vector<size_t> strides;
+        pattern.joint = pattern.hidden.size() <= 24 && joint_strides(pattern.hidden, strides) <= max_em_joint_states;
+        for (int i = 0; i < n_nodes; i++) {
+            std::vector<int> family_hidden;
+            for (int parent : node_list[i].get_parents())
+                if (std::binary_search(pattern.hidden.begin(), pattern.hidden.end(), parent))
+                    family_hidden.push_back(parent);
+            if (std::binary_search(pattern.hidden.begin(), pattern.hidden.end(), i))
+                family_hidden.push_back(i);
+            if (family_hidden.empty())
+                continue;
+            pattern.families.push_back(i);
+            if (!pattern.joint)
+                pattern.family_hidden.push_back(std::move(family_hidden));
+        }
+    }
+
+    std::vector<size_t> offsets(n_nodes + 1, 0);
+    for (int i = 0; i < n_nodes; i++)
+        offsets[i + 1] = offsets[i] + cpt_rows(i) * node_list[i].get_n_states();
+
+    size_t n_cases = case_counts.size();
+    size_t n_tasks = std::min(n_cases, (size_t) n_threads * 4); // a few tasks for each worker, since the cases have different costs
+    std::vector<std::vector<double>> counts(n_tasks);
+    std::vector<double> log_likelihoods(n_tasks);
+    std::vector<size_t> impossible(n_tasks);
+    double previous = 0;
+    for (int iteration = 1; iteration <= options.max_iterations; iteration++) {
+        BAYNET_TRACE_SCOPE("em_iteration");
+        std::vector<unsigned int> seeds(n_tasks);
+        {
+            std::lock_guard<std::mutex> lock(gen_mutex);
+            for (unsigned int& seed : seeds)
+                seed = gen();
+        }
+        // E-step
+        pool->parallel_for(n_tasks, [&](size_t t) {
+            BAYNET_TRACE_SCOPE("expected_counts");
+            std::default_random_engine engine(seeds[t]);
+            counts[t].assign(offsets.back(), 0);
+            log_likelihoods[t] = 0;
+            impossible[t] = 0;
+            std::vector<int> evidence(n_nodes);
+            for (size_t k = t * n_cases / n_tasks; k < (t + 1) * n_cases / n_tasks; k++) {
+                evidence.assign(cases.begin() + (std::ptrdiff_t) (k * n_nodes), cases.begin() + (std::ptrdiff_t) ((k + 1) * n_nodes));
+                double probability = expected_counts(evidence, case_counts[k], patterns[case_patterns[k]], options.algorithm,
+                                                     options.num_samples, offsets, counts[t], engine);
+                if (probability > 0)
+                    log_likelihoods[t] += case_counts[k] * std::log(probability);
+                else
+                    impossible[t] += (size_t) case_counts[k];
             }
+        });
+
+        // M-step
+        std::vector<double> total(offsets.back(), 0);
+        double log_likelihood = 0;
+        result.impossible_cases = 0;
+        for (size_t t = 0; t < n_tasks; t++) {
+            for (size_t k = 0; k < total.size(); k++)
+                total[k] += counts[t][k];
+            log_likelihood += log_likelihoods[t];
+            result.impossible_cases += impossible[t];
         }
-        // now, based on the evidence, I want to access the right probabilities
-        auto cpt = node.value();
-        std::vector<float> cond_probs = cpt[states_index];
+        for (int i = 0; i < n_nodes; i++)
+            install_counts(i, total.data() + offsets[i], options.learn);
 
-        sample[node.get_name()] = generate_sample(cond_probs, node.get_states()); // sample state from the distribution of the node
+        result.iterations = iteration;
+        result.log_likelihood = log_likelihood;
+        if (iteration > 1 && std::abs(log_likelihood - previous) <= options.tolerance * std::abs(previous)) {
+            result.converged = true;
+            break;
+        }
+        previous = log_likelihood;
     }
-    return sample;
+    return result;
 }
 
+double baynet::Graph::expected_counts(const std::vector<int>& evidence, double count, const MissingPattern& pattern, int algorithm,
+                                      int num_samples, const std::vector<size_t>& offsets, std::vector<double>& counts,
+                                      std::default_random_engine& engine) {
+    std::vector<int> states = evidence; // the evidence, then the states of the hidden nodes being filled
+    auto entry = [&](int i) -> double& { return counts[offsets[i] + view(i).row(states.data()) * node_list[i].get_n_states() + states[i]]; };
+
+    double probability = 1;
+    if (pattern.hidden.empty()) {
+        for (int i = 0; i < node_list.size(); i++)
+            probability *= family_probability(i, states);
+    } else if (algorithm == 0) {
+        // likelihood weighting: the weights of the samples are normalised once all of them are drawn
+        size_t n_hidden = pattern.hidden.size();
+        std::vector<double> weights(num_samples);
+        std::vector<int> samples(num_samples * n_hidden);
+        double total = 0;
+        for (int s = 0; s < num_samples; s++) {
+            weights[s] = weighted_states(states, evidence, all_nodes, engine);
+            total += weights[s];
+            for (size_t h = 0; h < n_hidden; h++)
+                samples[s * n_hidden + h] = states[pattern.hidden[h]];
+        }
+        probability = total / num_samples;
+        for (int s = 0; s < num_samples && total > 0; s++) {
+            if (weights[s] <= 0)
+                continue;
+            for (size_t h = 0; h < n_hidden; h++)
+                states[pattern.hidden[h]] = samples[s * n_hidden + h];
+            for (int i : pattern.families)
+                entry(i) += count * weights[s] / total;
+        }
+    } else {
+        // variable elimination: the joint table of the hidden nodes (or of the hidden nodes of a family) sums to P(evidence)
+        auto add_table = [&](const std::vector<int>& query, const std::vector<double>& table, std::span<const int> families) {
+            std::vector<size_t> strides;
+            joint_strides(query, strides);
+            for (size_t j = 0; j < table.size(); j++) {
+                if (table[j] <= 0)
+                    continue;
+                for (size_t k = 0; k < query.size(); k++)
+                    states[query[k]] = (int) ((j / strides[k]) % node_list[query[k]].get_n_states());
+                for (int i : families)
+                    entry(i) += count * table[j] / probability;
+            }
+        };
+        if (pattern.joint) {
+            std::vector<double> table = joint_table(pattern.hidden, evidence);
+            probability = std::accumulate(table.begin(), table.end(), 0.0);
+            if (probability > 0)
+                add_table(pattern.hidden, table, pattern.families);
+        } else {
+            for (size_t f = 0; f < pattern.families.size(); f++) {
+                std::vector<double> table = joint_table(pattern.family_hidden[f], evidence);
+                if (f == 0)
+                    probability = std::accumulate(table.begin(), table.end(), 0.0);
+                if (probability <= 0)
+                    break;
+                add_table(pattern.family_hidden[f], table, std::span<const int>(&pattern.families[f], 1));
+            }
+        }
+    }
+    if (probability <= 0)
+        return 0; // an impossible case adds nothing
+
+    // the families without hidden nodes are observed: their entry gets the whole count
+    states = evidence;
+    for (int i = 0, f = 0; i < node_list.size(); i++) {
+        if (f < pattern.families.size() && pattern.families[f] == i)
+            f++;
+        else
+            entry(i) += count;
+    }
+    return probability;
+}
 
-std::tuple<std::unordered_map<std::string,std::string>, float> baynet::Graph::weighted_sample(const std::unordered_map<std::string, std::string>& evidence) {
+
+int baynet::Graph::generate_sample(const float* cumulative, size_t n, std::default_random_engine& engine) {
     std::uniform_real_distribution<float> dis(0,1);
+    return CumulativeCpt::sample(cumulative, n, dis(engine)); // generate random number [0,1)
+}
 
-    std::unordered_map<std::string,std::string> sample;
-    float w = 1;
-    for (auto& node : node_list) {
-        unsigned int states_index = 0;
-
-        bool is_evidence = false;
-        for (auto& e : evidence) {
-            if (e.first == node.get_name()) {
-                is_evidence = true;
-                sample[node.get_name()] = e.second;
-                break;
-            }
-        }
 
-        if (!node.get_parents().empty()) { // not a root node
-            // retrieve the index to access the correct probabilities in the CPT given all the parents states (the current evidence)
-            std::vector<unsigned int> parent_weight = node.get_parent_weight_states();
-            for (int i = 0; i < node.get_parents().size(); i++) {
-                states_index += node_list[node_indexes[node.get_parents()[i]]].get_states_map()[sample[node.get_parents()[i]]] * parent_weight[i];
-            }
+std::unordered_map<std::string,std::string> baynet::Graph::prior_sample() {
+    load_cpts(all_nodes);
+    std::vector<int> states(node_list.size(), -1);
+    {
+        std::lock_guard<std::mutex> lock(gen_mutex);
+        sample_states(states, all_nodes, gen);
+    }
+    return states_to_map(states);
+}
+
+void baynet::Graph::sample_states(std::vector<int>& states, const std::vector<bool>& relevant, std::default_random_engine& engine) const {
+    thread_local std::vector<float> cond_probs; // distribution of the noisy-MAX nodes, reused by the samples of the thread
+
+    for (int n = 0; n < node_list.size(); n++) {
+        if (!relevant[n])
+            continue;
+        NodeView node = view(n);
+        // retrieve the index to access the correct probabilities in the CPT given all the parents states (the current evidence)
+        size_t states_index = node.row(states.data());
+
+        // deterministic nodes do not need a random draw
+        if (node.is_deterministic()) {
+            states[n] = node.resulting_states()[states_index];
+            continue;
+        }
+        // quantised cpts are sampled with a 16-bit uniform
+        if (node.is_quantized()) {
+            std::uniform_int_distribution<uint32_t> dis(0, QuantizedCpt::scale - 1);
+            states[n] = node.quantized().sample(states_index, dis(engine));
+            continue;
         }
-        // now, based on the evidence, I want to access the right probabilities
-        auto cpt = node.value();
-        std::vector<float> cond_probs = cpt[states_index];
 
-        if (is_evidence) {
-            w *= cond_probs[node.get_states_map()[sample[node.get_name()]]];
+        // now, based on the evidence, I want to access the right probabilities (computed on the fly for noisy-MAX nodes)
+        if (node.is_noisy_max()) {
+            size_t n_states = node.n_states();
+            cond_probs.resize(n_states);
+            node.noisy_max().distribution(states_index, cond_probs.data());
+            CumulativeCpt::accumulate(cond_probs.data(), n_states);
+            states[n] = generate_sample(cond_probs.data(), n_states, engine);
         } else {
-            sample[node.get_name()] = generate_sample(cond_probs, node.get_states()); // sample state from the distribution of the node
+            std::uniform_real_distribution<float> dis(0,1);
+            states[n] = node.cumulative().sample(states_index, dis(engine)); // sample state from the distribution of the node
         }
     }
-    return std::make_tuple(sample, w);
 }
 
-std::vector<float> baynet::Graph::rejection_sampling(const std::string& query, int num_samples) {
-    std::vector<std::string> tokens = utils::split_string(query, '|');
-    std::string query_variable = tokens[0];
-    std::vector<std::string> evidence_variables = utils::split_string(tokens[1], ',');
-
-    // check user input
-    if (check_query_validity(query_variable) == 1)
-        throw std::invalid_argument("Invalid query name.");
 
-    for (const std::string& evidence: evidence_variables)
-        if (check_query_validity(utils::split_string(evidence, '=')[0]) == 1)
+std::tuple<std::unordered_map<std::string,std::string>, float> baynet::Graph::weighted_sample(const std::unordered_map<std::string, std::string>& evidence) {
+    std::vector<int> evidence_states(node_list.size(), -1);
+    for (auto& e : evidence) {
+        int index = get_node_index(e.first);
+        if (index < 0)
             throw std::invalid_argument("Invalid evidence name.");
+        evidence_states[index] = node_list[index].get_state_index(e.second);
+        if (evidence_states[index] < 0)
+            throw std::invalid_argument("Invalid evidence state.");
+    }
+    load_cpts(all_nodes);
+    std::vector<int> states(node_list.size(), -1);
+    float w;
+    {
+        std::lock_guard<std::mutex> lock(gen_mutex);
+        w = weighted_states(states, evidence_states, all_nodes, gen);
+    }
+    return std::make_tuple(states_to_map(states), w);
+}
 
-    std::unordered_map<std::string, std::string> evidence_states;
-    std::vector<float> posteriors(node_list[node_indexes[query_variable]].get_states().size(), 0);
+float baynet::Graph::weighted_states(std::vector<int>& states, const std::vector<int>& evidence, const std::vector<bool>& relevant,
+                                     std::default_random_engine& engine) const {
+    thread_local std::vector<float> cond_probs; // distribution of the noisy-MAX nodes, reused by the samples of the thread
 
-    for (const std::string &ev: evidence_variables) {
-        std::vector<std::string> tok = utils::split_string(ev, '=');
-        evidence_states[tok[0]] = tok[1];
+    float w = 1;
+    for (int n = 0; n < node_list.size(); n++) {
+        if (!relevant[n])
+            continue;
+        NodeView node = view(n);
+        bool is_evidence = evidence[n] >= 0;
+        if (is_evidence)
+            states[n] = evidence[n];
+
+        // retrieve the index to access the correct probabilities in the CPT given all the parents states (the current evidence)
+        size_t states_index = node.row(states.data());
+
+        // deterministic nodes do not need a random draw: evidence on them has weight 1 if it matches the resulting state, 0 otherwise
+        if (node.is_deterministic()) {
+            int resulting = node.resulting_states()[states_index];
+            if (is_evidence) {
+                if (states[n] != resulting)
+                    w = 0;
+            } else {
+                states[n] = resulting;
+            }
+            continue;
+        }
+        if (node.is_quantized()) {
+            const QuantizedCpt& quantized = node.quantized();
+            if (is_evidence) {
+                w *= quantized.probability(states_index, states[n]);
+            } else {
+                std::uniform_int_distribution<uint32_t> dis(0, QuantizedCpt::scale - 1);
+                states[n] = quantized.sample(states_index, dis(engine));
+            }
+            continue;
+        }
+
+        // now, based on the evidence, I want to access the right probabilities (computed on the fly for noisy-MAX nodes)
+        if (node.is_noisy_max()) {
+            size_t n_states = node.n_states();
+            cond_probs.resize(n_states);
+            node.noisy_max().distribution(states_index, cond_probs.data());
+            if (is_evidence) {
+                w *= cond_probs[states[n]];
+            } else {
+                CumulativeCpt::accumulate(cond_probs.data(), n_states);
+                states[n] = generate_sample(cond_probs.data(), n_states, engine);
+            }
+        } else if (is_evidence) {
+            w *= node.cpt()[states_index][states[n]]; // the exact probability, not a difference of prefix sums
+        } else {
+            std::uniform_real_distribution<float> dis(0,1);
+            states[n] = node.cumulative().sample(states_index, dis(engine)); // sample state from the distribution of the node
+        }
     }
+    return w;
+}
 
-    int n_thread = (int) std::thread::hardware_concurrency() - 1;
-    int iterations = num_samples / n_thread;
-    int left = num_samples % n_thread;
+std::unordered_map<std::string,std::string> baynet::Graph::states_to_map(const std::vector<int>& states) const {
+    std::unordered_map<std::string,std::string> sample;
+    for (int n = 0; n < node_list.size(); n++)
+        if (states[n] >= 0)
+            sample[std::string(node_list[n].get_name())] = node_list[n].get_state(states[n]);
+    return sample;
+}
 
-    auto t_fun = [&](int iterations) {
-        std::vector<float> local_posteriors(node_list[node_indexes[query_variable]].get_states().size(), 0);
+baynet::QueryResult baynet::Graph::rejection_sampling(const std::vector<int>& query, const std::vector<int>& evidence_states, int num_samples,
+                                                     const QueryControl* control) {
+    BAYNET_TRACE_SCOPE("rejection_sampling");
+    std::vector<size_t> strides;
+    size_t n_states = joint_strides(query, strides);
+
+    // only the ancestors of the query and of the evidence are sampled
+    std::vector<int> evidence_nodes;
+    for (int i = 0; i < node_list.size(); i++)
+        if (evidence_states[i] >= 0)
+            evidence_nodes.push_back(i);
+    std::vector<int> targets = evidence_nodes;
+    targets.insert(targets.end(), query.begin(), query.end());
+    std::vector<bool> relevant = relevant_nodes(targets);
+    load_cpts(relevant);
+
+    auto t_fun = [&](int iterations, std::default_random_engine& engine) {
+        std::vector<double> local_posteriors(n_states, 0);
+        std::vector<int> sample(node_list.size(), -1); // reused by all the samples of the worker
+        BAYNET_STATS(uint64_t rejected = 0;)
         for (int i = 0; i < iterations; i++) {
-            std::unordered_map<std::string, std::string> sample = prior_sample();
+            sample_states(sample, relevant, engine);
 
             // count only the samples that are consistent with the evidence
             bool consistent = true;
-            for (auto &m: evidence_states) {
-                if (sample[m.first] != m.second)
+            for (int e : evidence_nodes) {
+                if (sample[e] != evidence_states[e])
                     consistent = false;
             }
-            if (!consistent)
+            if (!consistent) {
+                BAYNET_STATS(rejected++;)
                 continue;
+            }
 
-            // posteriors[index of state that has been sampled for this query variable]
-            local_posteriors[node_list[node_indexes[query_variable]].get_states_map()[sample[query_variable]]]++;
+            // posteriors[index of the joint state that has been sampled for the query variables]
+            local_posteriors[joint_index(sample, query, strides)]++;
         }
+        BAYNET_STATS(
+            stats_collector.samples_drawn += iterations;
+            stats_collector.samples_rejected += rejected;
+        )
         return local_posteriors;
     };
 
-    std::vector<std::future<std::vector<float>>> t_results;
-    t_results.reserve(n_thread);
-    for (int i = 0; i < n_thread; i++) {
-        if (i == 0)
-            t_results.emplace_back(std::async(std::launch::async, t_fun, iterations + left));
-        else
-            t_results.emplace_back(std::async(std::launch::async, t_fun, iterations));
-    }
-
-    for (auto &res: t_results) {
-        std::vector<float> loc_posteriors = res.get();
-        for (int i = 0; i < posteriors.size(); i++)
-            posteriors[i] += loc_posteriors[i];
-    }
+    QueryResult result;
+    std::vector<double> posteriors = run_workers(num_samples, n_states, t_fun, control, result.samples_used);
+    result.stopped = result.samples_used < num_samples;
 
-    return utils::normalize(posteriors);
+    BAYNET_STATS(StatsTimer timer(stats_collector.normalization_ns);)
+    std::vector<double> normalized = utils::normalize(posteriors, round_results);
+    result.probabilities.assign(normalized.begin(), normalized.end());
+    return result;
 }
 
-std::vector<float> baynet::Graph::likelihood_weighting(const std::string& query, int num_samples) {
-    std::vector<std::string> tokens = utils::split_string(query, '|');
-    std::string query_variable = tokens[0];
-    std::vector<std::string> evidence_variables = utils::split_string(tokens[1], ',');
+baynet::QueryResult baynet::Graph::likelihood_weighting(const std::vector<int>& query, const std::vector<int>& evidence_states, int num_samples,
+                                                       const QueryControl* control) {
+    BAYNET_TRACE_SCOPE("likelihood_weighting");
+    std::vector<size_t> strides;
+    size_t n_states = joint_strides(query, strides);
+
+    // only the ancestors of the query and of the evidence are sampled
+    std::vector<int> targets = query;
+    for (int i = 0; i < node_list.size(); i++)
+        if (evidence_states[i] >= 0)
+            targets.push_back(i);
+    std::vector<bool> relevant = relevant_nodes(targets);
+    load_cpts(relevant);
+
+    BAYNET_STATS(std::atomic<double> squared_weights = 0;) // used for the effective sample size
+
+    auto t_fun = [&](int iterations, std::default_random_engine& engine) {
+        std::vector<double> local_posteriors(n_states, 0);
+        std::vector<int> sample(node_list.size(), -1); // reused by all the samples of the worker
+        BAYNET_STATS(double local_squared_weights = 0;)
+        for (int i = 0; i < iterations; i++) {
+            float w = weighted_states(sample, evidence_states, relevant, engine);
+            local_posteriors[joint_index(sample, query, strides)] += w;
+            BAYNET_STATS(local_squared_weights += (double) w * w;)
+        }
+        BAYNET_STATS(
+            stats_collector.samples_drawn += iterations;
+            squared_weights += local_squared_weights;
+        )
+        return local_posteriors;
+    };
 
-    // check user input
-    if (check_query_validity(query_variable) == 1)
-        throw std::invalid_argument("Invalid query name.");
+    QueryResult result;
+    std::vector<double> posteriors = run_workers(num_samples, n_states, t_fun, control, result.samples_used);
+    result.stopped = result.samples_used < num_samples;
+
+    BAYNET_STATS(
+        double total_weight = 0;
+        for (double w : posteriors)
+            total_weight += w;
+        stats_collector.effective_sample_size = squared_weights > 0 ? total_weight * total_weight / squared_weights : 0;
+    )
+
+    BAYNET_STATS(StatsTimer timer(stats_collector.normalization_ns);)
+    std::vector<double> normalized = utils::normalize(posteriors, round_results);
+    result.probabilities.assign(normalized.begin(), normalized.end());
+    return result;
+}
 
-    for (const std::string& evidence: evidence_variables)
-        if (check_query_validity(utils::split_string(evidence, '=')[0]) == 1)
-            throw std::invalid_argument("Invalid evidence name.");
+baynet::QueryResult baynet::Graph::forward_sampling(const std::vector<int>& query, int num_samples, const QueryControl* control) {
+    BAYNET_TRACE_SCOPE("forward_sampling");
+    std::vector<size_t> strides;
+    size_t n_states = joint_strides(query, strides);
+    std::vector<bool> relevant = relevant_nodes(query);
+    load_cpts(relevant);
+
+    auto t_fun = [&](int iterations, std::default_random_engine& engine) {
+        std::vector<double> local_posteriors(n_states, 0);
+        std::vector<int> sample(node_list.size(), -1); // reused by all the samples of the worker
+        for (int i = 0; i < iterations; i++) {
+            sample_states(sample, relevant, engine);
+            // posteriors[index of the joint state that has been sampled for the query variables]
+            local_posteriors[joint_index(sample, query, strides)]++;
+        }
+        BAYNET_STATS(stats_collector.samples_drawn += iterations;)
+        return local_posteriors;
+    };
 
-    std::unordered_map<std::string, std::string> evidence_states;
-    std::vector<float> posteriors(node_list[node_indexes[query_variable]].get_states().size(), 0);
+    QueryResult result;
+    std::vector<double> posteriors = run_workers(num_samples, n_states, t_fun, control, result.samples_used);
+    result.stopped = result.samples_used < num_samples;
 
-    for (const std::string &ev: evidence_variables) {
-        std::vector<std::string> tok = utils::split_string(ev, '=');
-        evidence_states[tok[0]] = tok[1];
-    }
+    BAYNET_STATS(StatsTimer timer(stats_collector.normalization_ns);)
+    std::vector<double> normalized = utils::normalize(posteriors, round_results);
+    result.probabilities.assign(normalized.begin(), normalized.end());
+    return result;
+}
 
-    int n_thread = (int) std::thread::hardware_concurrency() - 1;
-    int iterations = num_samples / n_thread;
-    int left = num_samples % n_thread;
+std::vector<double> baynet::Graph::run_workers(int num_samples, size_t n_states,
+                                              const std::function<std::vector<double>(int, std::default_random_engine&)>& t_fun,
+                                              const QueryControl* control, int& samples_used) {
+    int iterations = num_samples / n_threads;
+    int left = num_samples % n_threads;
+    std::atomic<int> drawn_samples = 0;
+
+    auto task = [&](int iterations, unsigned int seed, bool first) {
+        BAYNET_TRACE_SCOPE("worker");
+        std::default_random_engine engine(seed);
+        if (!control) {
+            std::vector<double> local_posteriors = t_fun(iterations, engine);
+            drawn_samples += iterations;
+            return local_posteriors;
+        }
 
-    auto t_fun = [&](int iterations) {
-        std::vector<float> local_posteriors(node_list[node_indexes[query_variable]].get_states().size(), 0);
-        for (int i = 0; i < iterations; i++) {
-            std::tuple<std::unordered_map<std::string, std::string>, float> sample_weight = weighted_sample(
-                    evidence_states);
-            std::unordered_map<std::string, std::string> sample = std::get<0>(sample_weight);
-            float w = std::get<1>(sample_weight);
-            local_posteriors[node_list[node_indexes[query_variable]].get_states_map()[sample[query_variable]]] += w;
+        // the samples are drawn in chunks, checking the control in between
+        std::vector<double> local_posteriors(n_states, 0);
+        int drawn = 0;
+        while (drawn < iterations && ((first && drawn == 0) || !control->stop_requested())) {
+            int chunk = std::min(control_chunk, iterations - drawn);
+            std::vector<double> chunk_posteriors = t_fun(chunk, engine);
+            for (size_t i = 0; i < n_states; i++)
+                local_posteriors[i] += chunk_posteriors[i];
+            drawn += chunk;
         }
+        drawn_samples += drawn;
         return local_posteriors;
     };
 
-    std::vector<std::future<std::vector<float>>> t_results;
-    t_results.reserve(n_thread);
-    for (int i = 0; i < n_thread; i++) {
-        if (i == 0)
-            t_results.emplace_back(std::async(std::launch::async, t_fun, iterations + left));
-        else
-            t_results.emplace_back(std::async(std::launch::async, t_fun, iterations));
+    std::vector<unsigned int> seeds(n_threads);
+    {
+        std::lock_guard<std::mutex> lock(gen_mutex);
+        for (unsigned int& seed : seeds)
+            seed = gen();
     }
 
+    std::vector<std::future<std::vector<double>>> t_results;
+    t_results.reserve(n_threads);
+    BAYNET_STATS(StatsTimer sampling_timer(stats_collector.sampling_ns);)
+    for (int i = 0; i < n_threads; i++) {
+        int n = i == 0 ? iterations + left : iterations;
+        unsigned int seed = seeds[i];
+        t_results.emplace_back(pool->submit([&task, n, seed, i] { return task(n, seed, i == 0); }));
+        BAYNET_STATS(stats_collector.task_queued(pool->queue_depth());)
+    }
+    for (auto &res: t_results)
+        pool->wait(res);
+    BAYNET_STATS(sampling_timer.stop();)
+
+    BAYNET_STATS(StatsTimer reduction_timer(stats_collector.reduction_ns);)
+    BAYNET_TRACE_SCOPE("reduce");
+    std::vector<double> posteriors(n_states, 0);
     for (auto &res: t_results) {
-        std::vector<float> loc_posteriors = res.get();
+        std::vector<double> loc_posteriors = res.get();
         for (int i = 0; i < posteriors.size(); i++)
             posteriors[i] += loc_posteriors[i];
     }
+    samples_used = drawn_samples;
+    return posteriors;
+}
+
+std::vector<float> baynet::Graph::variable_elimination(const std::vector<int>& query, const std::vector<int>& evidence_states) {
+    BAYNET_TRACE_SCOPE("variable_elimination");
+    std::vector<size_t> strides;
+    std::vector<float> posteriors(joint_strides(query, strides), 0);
+    if (std::all_of(query.begin(), query.end(), [&](int q) { return evidence_states[q] >= 0; })) {
+        posteriors[joint_index(evidence_states, query, strides)] = 1;
+        return posteriors;
+    }
+
+    std::vector<double> table = joint_table(query, evidence_states);
+
+    // normalised in double: the unnormalised table can be far below the smallest float when the evidence is unlikely
+    BAYNET_STATS(StatsTimer timer(stats_collector.normalization_ns);)
+    table = utils::normalize(table, round_results);
+    for (size_t j = 0; j < posteriors.size(); j++)
+        posteriors[j] = (float) table[j];
+    return posteriors;
+}
 
-    return utils::normalize(posteriors);
+std::vector<double> baynet::Graph::joint_table(const std::vector<int>& query, const std::vector<int>& evidence_states) {
+    std::vector<size_t> strides;
+    std::vector<double> table(joint_strides(query, strides), 0);
+
+    // the nodes that are not ancestors of the query or of the evidence sum out to 1, so they are skipped
+    std::vector<int> targets = query;
+    for (int i = 0; i < node_list.size(); i++)
+        if (evidence_states[i] >= 0)
+            targets.push_back(i);
+    std::vector<bool> relevant = relevant_nodes(targets);
+    load_cpts(relevant);
+    int next_aux = (int) node_list.size();
+    std::vector<Factor> factors = reduced_factors(relevant, evidence_states, next_aux);
+
+    // the product factor of the query nodes without evidence: the joint states that contradict the evidence stay at 0
+    Factor result = eliminate(std::move(factors), query);
+    std::vector<int> states = evidence_states; // the evidence, then the joint state of the query nodes being filled
+    for (size_t j = 0; j < table.size(); j++) {
+        bool consistent = true;
+        for (size_t k = 0; k < query.size(); k++) {
+            int state = (int) ((j / strides[k]) % node_list[query[k]].get_n_states());
+            consistent = consistent && (evidence_states[query[k]] < 0 || evidence_states[query[k]] == state);
+            states[query[k]] = state;
+        }
+        if (consistent)
+            table[j] = result.value_at(states);
+    }
+    return table;
 }
 
-std::vector<float> baynet::Graph::forward_sampling(const std::string& query, int num_samples) {
-    std::vector<float> posteriors(node_list[node_indexes[query]].get_states().size(), 0);
-    int n_thread = (int) std::thread::hardware_concurrency() - 1;
-    int iterations = num_samples / n_thread;
-    int left = num_samples % n_thread;
+std::vector<Factor> baynet::Graph::reduced_factors(const std::vector<bool>& relevant, const std::vector<int>& evidence_states, int& next_aux) {
+    std::vector<Factor> factors;
+    for (int i = 0; i < node_list.size(); i++) {
+        if (!relevant[i])
+            continue;
+        for (Factor& factor : node_factors(i, next_aux)) {
+            for (int j : std::vector<int>(factor.vars))
+                if (j < node_list.size() && evidence_states[j] >= 0)
+                    factor = factor.reduce(j, evidence_states[j]);
+            factors.push_back(std::move(factor));
+        }
+    }
+    return factors;
+}
 
-    auto t_fun = [&](int iterations) {
-        std::vector<float> local_posteriors(node_list[node_indexes[query]].get_states().size(), 0);
+baynet::EvidenceProbability baynet::Graph::evidence_probability(std::span<const EvidenceItem> evidence, int num_samples, int algorithm,
+                                                                const QueryControl& control) {
+    BAYNET_TRACE_SCOPE("evidence_probability");
+    check_algorithm(algorithm);
+    if (algorithm != 2 && num_samples <= 0)
+        throw std::invalid_argument("The estimate of P(evidence) needs at least one sample");
+    std::vector<int> states = evidence_states(evidence);
+    EvidenceProbability result;
+    if (evidence.empty())
+        return result;
+
+    // only the ancestors of the evidence are needed: the other nodes sum out to 1
+    std::vector<int> targets;
+    for (const EvidenceItem& e : evidence)
+        targets.push_back(e.node);
+    std::vector<bool> relevant = relevant_nodes(targets);
+    load_cpts(relevant);
+
+    if (algorithm == 2) {
+        int next_aux = (int) node_list.size();
+        result.probability = eliminate(reduced_factors(relevant, states, next_aux), {}).total();
+        return result;
+    }
+
+    // the estimate is the mean of the weights of the samples: their likelihood weight, or 1 if a prior sample agrees with
+    // the evidence and 0 otherwise (rejection sampling). The sums are kept in double within each task
+    auto t_fun = [&](int iterations, std::default_random_engine& engine) {
+        std::vector<int> sample(node_list.size(), -1); // reused by all the samples of the worker
+        double sum = 0, sum_squares = 0;
         for (int i = 0; i < iterations; i++) {
-            std::unordered_map<std::string, std::string> sample = prior_sample();
-            // posteriors[index of state that has been sampled for this query variable]
-            local_posteriors[node_list[node_indexes[query]].get_states_map()[sample[query]]]++;
+            double w;
+            if (algorithm == 0) {
+                w = weighted_states(sample, states, relevant, engine);
+            } else {
+                sample_states(sample, relevant, engine);
+                w = std::all_of(targets.begin(), targets.end(), [&](int e) { return sample[e] == states[e]; }) ? 1 : 0;
+            }
+            sum += w;
+            sum_squares += w * w;
         }
-        return local_posteriors;
+        BAYNET_STATS(stats_collector.samples_drawn += iterations;)
+        return std::vector<double>{sum, sum_squares};
     };
 
-    std::vector<std::future<std::vector<float>>> t_results;
-    t_results.reserve(n_thread);
-    for (int i = 0; i < n_thread; i++) {
-        if (i == 0)
-            t_results.emplace_back(std::async(std::launch::async, t_fun, iterations + left));
-        else
-            t_results.emplace_back(std::async(std::launch::async, t_fun, iterations));
-    }
+    // the first worker draws its first chunk even if control is stopped, so that n is at least 1
+    std::vector<double> sums = run_workers(num_samples, 2, t_fun, &control, result.samples_used);
+    double n = result.samples_used;
+    result.probability = sums[0] / n;
+    // variance of the mean: the sample variance of the weights divided by the number of samples
+    if (n > 1)
+        result.variance = std::max(0.0, (sums[1] - n * result.probability * result.probability) / (n - 1)) / n;
+    return result;
+}
 
-    for (auto &res: t_results) {
-        std::vector<float> loc_posteriors = res.get();
-        for (int i = 0; i < posteriors.size(); i++)
-            posteriors[i] += loc_posteriors[i];
+std::vector<double> baynet::Graph::score_rows(std::span<const int> states, size_t n_rows) {
+    BAYNET_TRACE_SCOPE("score_rows");
+    size_t n_nodes = node_list.size();
+    if (states.size() != n_nodes * n_rows)
+        throw std::invalid_argument("The matrix must have a column of n_rows states for each node.");
+    load_cpts(all_nodes);
+
+    // ln P(state | row of the parents) of every node, laid out like its cpt, so that a complete row only needs a gather per node.
+    // Nodes with too many rows (large noisy-MAX nodes) are evaluated row by row instead
+    std::vector<std::vector<double>> log_tables(n_nodes);
+    pool->parallel_for(n_nodes, [&](size_t i) {
+        size_t n_states = node_list[i].get_n_states();
+        size_t table_rows = cpt_rows((int) i);
+        if (table_rows * n_states > max_score_table)
+            return;
+        NodeView node = view((int) i);
+        std::vector<float> distribution(n_states); // a row of a noisy-MAX node, computed once for all its states
+        std::vector<double>& table = log_tables[i];
+        table.resize(table_rows * n_states);
+        for (size_t r = 0; r < table_rows; r++) {
+            if (node.is_noisy_max())
+                node.noisy_max().distribution(r, distribution.data());
+            for (size_t s = 0; s < n_states; s++)
+                table[r * n_states + s] = std::log(node.is_noisy_max() ? distribution[s] : row_probability((int) i, r, (int) s));
+        }
+    });
+
+    // blocks of rows: the complete ones are copied into a dense column-major block and scored a node at a time, the others
+    // get P(observed states) from variable elimination
+    std::vector<double> scores(n_rows, 0);
+    size_t n_blocks = (n_rows + score_block - 1) / score_block;
+    pool->parallel_for(n_blocks, [&](size_t b) {
+        BAYNET_TRACE_SCOPE("score_block");
+        size_t begin = b * score_block, end = std::min(n_rows, begin + score_block);
+        std::vector<size_t> complete;
+        std::unordered_map<std::string, double> incomplete; // key: the bytes of the states
+        std::vector<int> evidence(n_nodes);
+        for (size_t r = begin; r < end; r++) {
+            bool missing = false;
+            for (size_t i = 0; i < n_nodes; i++) {
+                int state = states[i * n_rows + r];
+                if (state < -1 || state >= (int) node_list[i].get_n_states())
+                    throw std::invalid_argument("Invalid state " + std::to_string(state) + " of node " + std::string(node_list[i].get_name()) +
+                                                " in row " + std::to_string(r));
+                missing = missing || state < 0;
+            }
+            if (!missing) {
+                complete.push_back(r);
+                continue;
+            }
+            std::vector<int> observed;
+            for (size_t i = 0; i < n_nodes; i++) {
+                evidence[i] = states[i * n_rows + r];
+                if (evidence[i] >= 0)
+                    observed.push_back((int) i);
+            }
+            if (observed.empty())
+                continue; // ln 1
+            // the same incomplete row is eliminated once for each block
+            auto [it, inserted] = incomplete.try_emplace(std::string((const char*) evidence.data(), n_nodes * sizeof(int)), 0);
+            if (inserted) {
+                int next_aux = (int) n_nodes;
+                it->second = std::log(eliminate(reduced_factors(relevant_nodes(observed), evidence, next_aux), {}).total());
+            }
+            scores[r] = it->second;
+        }
+
+        size_t m = complete.size();
+        std::vector<int> block(n_nodes * m);
+        for (size_t i = 0; i < n_nodes; i++)
+            for (size_t k = 0; k < m; k++)
+                block[i * m + k] = states[i * n_rows + complete[k]];
+        std::vector<size_t> rows(m);
+        std::vector<double> log_probabilities(m, 0);
+        for (size_t i = 0; i < n_nodes; i++) {
+            NodeView node = view((int) i);
+            const int* own = block.data() + i * m;
+            // row of the cpt from the strides of the parents, then one gather (or a direct evaluation for the untabulated nodes)
+            std::fill(rows.begin(), rows.end(), 0);
+            for (size_t p = 0; p < node.parents().size(); p++) {
+                const int* parent = block.data() + node.parents()[p] * m;
+                size_t weight = node.parent_weights()[p];
+                for (size_t k = 0; k < m; k++)
+                    rows[k] += (size_t) parent[k] * weight;
+            }
+            if (log_tables[i].empty()) {
+                for (size_t k = 0; k < m; k++)
+                    log_probabilities[k] += std::log(row_probability((int) i, rows[k], own[k]));
+                continue;
+            }
+            size_t n_states = node.n_states();
+            const double* table = log_tables[i].data();
+            for (size_t k = 0; k < m; k++)
+                log_probabilities[k] += table[rows[k] * n_states + own[k]];
+        }
+        for (size_t k = 0; k < m; k++)
+            scores[complete[k]] = log_probabilities[k];
+    });
+    return scores;
+}
+
+size_t baynet::Graph::joint_strides(const std::vector<int>& query, std::vector<size_t>& strides) const {
+    strides.assign(query.size(), 0);
+    size_t size = 1;
+    for (int k = (int) query.size() - 1; k >= 0; k--) {
+        strides[k] = size;
+        size *= node_list[query[k]].get_n_states();
     }
+    return size;
+}
 
-    return utils::normalize(posteriors);
+baynet::Explanation baynet::Graph::most_probable_explanation(std::span<const EvidenceItem> evidence) {
+    BAYNET_TRACE_SCOPE("most_probable_explanation");
+    std::vector<int> states = evidence_states(evidence);
+    // every node is explained: the nodes that are not ancestors of the evidence cannot be skipped, their best state matters
+    std::vector<int> nodes;
+    for (int i = 0; i < node_list.size(); i++)
+        if (states[i] < 0)
+            nodes.push_back(i);
+    return exact_map(nodes, states, all_nodes);
 }
 
-int baynet::Graph::check_query_validity(const std::string& s){
-    for(auto &v : node_list){
-        if(v.get_name() == s) return 0;
+baynet::Explanation baynet::Graph::maximum_a_posteriori(std::span<const NodeId> nodes, std::span<const EvidenceItem> evidence) {
+    BAYNET_TRACE_SCOPE("maximum_a_posteriori");
+    std::vector<int> states = evidence_states(evidence);
+    std::vector<int> targets;
+    for (NodeId node : nodes) {
+        if (node < 0 || node >= node_list.size())
+            throw std::invalid_argument("Invalid MAP node.");
+        if (std::find(targets.begin(), targets.end(), node) == targets.end())
+            targets.push_back(node);
     }
-    return 1;
+    std::sort(targets.begin(), targets.end());
+    std::vector<int> relevant_targets = targets;
+    for (const EvidenceItem& e : evidence)
+        relevant_targets.push_back(e.node);
+    // the nodes that are not ancestors of the MAP nodes or of the evidence sum out to 1, so they are skipped
+    return exact_map(targets, states, relevant_nodes(relevant_targets));
 }
 
-std::unordered_map<std::string, std::vector<float>> baynet::Graph::inference(int num_samples, const std::string& evidence, int algorithm) {
-    std::unordered_map<std::string, std::vector<float>> results;
+baynet::Explanation baynet::Graph::exact_map(const std::vector<int>& nodes, const std::vector<int>& evidence_states,
+                                             const std::vector<bool>& relevant) {
+    load_cpts(relevant);
+    int next_aux = (int) node_list.size();
+    std::vector<Factor> factors = reduced_factors(relevant, evidence_states, next_aux);
+
+    std::vector<int> maximize;
+    for (int node : nodes)
+        if (evidence_states[node] < 0)
+            maximize.push_back(node);
+    std::vector<int> best_states = evidence_states;
+    best_states.resize(next_aux, 0);
+
+    Explanation explanation;
+    explanation.log_probability = max_product_eliminate(std::move(factors), maximize, best_states);
+    for (int node : nodes)
+        explanation.assignment.push_back({node, best_states[node]});
+    return explanation;
+}
 
-    for (auto& node : node_list) {
-        try {
-            std::string query;
-            std::vector<float> posteriors;
+baynet::Explanation baynet::Graph::approximate_mpe(std::span<const EvidenceItem> evidence, const QueryControl& control, int max_steps) {
+    BAYNET_TRACE_SCOPE("approximate_mpe");
+    std::vector<int> observed = evidence_states(evidence);
+    load_cpts(all_nodes);
+
+    std::vector<std::vector<int>> children(node_list.size());
+    for (int i = 0; i < node_list.size(); i++)
+        for (int parent : node_list[i].get_parents())
+            children[parent].push_back(i);
+
+    // the moves change one free node: deterministic nodes without evidence are recomputed from their parents
+    std::vector<int> free_nodes;
+    for (int i = 0; i < node_list.size(); i++)
+        if (observed[i] < 0 && !node_list[i].is_deterministic() && node_list[i].get_n_states() > 1)
+            free_nodes.push_back(i);
+
+    // a score is the number of impossible families and the log probability of the others, compared in this order,
+    // so that the search can leave the states that contradict the evidence
+    struct Score {
+        int zeros = 0;
+        double log = 0;
+        void add(double p, int sign) {
+            if (p > 0)
+                log += sign * std::log(p);
+            else
+                zeros += sign;
+        }
+        bool better_than(const Score& other) const {
+            return zeros != other.zeros ? zeros < other.zeros : log > other.log;
+        }
+    };
 
-            if (evidence.empty()) {
-                query = node.get_name();
-                posteriors = forward_sampling(query, num_samples);
+    std::default_random_engine engine;
+    {
+        std::lock_guard<std::mutex> lock(gen_mutex);
+        engine.seed(gen());
+    }
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    auto restart = [&](std::vector<int>& states) {
+        weighted_states(states, observed, all_nodes, engine);
+        Score score;
+        for (int i = 0; i < node_list.size(); i++)
+            score.add(family_probability(i, states), 1);
+        return score;
+    };
+
+    std::vector<int> states(node_list.size(), -1);
+    Score current = restart(states);
+    std::vector<int> best_states = states;
+    Score best = current;
+
+    std::vector<int> changed; // the moved node and the deterministic nodes that follow it
+    std::vector<int> families; // nodes whose probability depends on the changed ones
+    std::vector<Score> candidates; // score of the families for each state of the moved node
+    std::vector<double> weights;
+    std::vector<int> mark(node_list.size(), -1);
+    // the runs start short, so that a tight deadline still sees a complete cooling, and double up to a limit
+    const double start_temperature = 0.5, end_temperature = 0.02;
+    const long max_run_steps = std::max(1000L, 500L * (long) free_nodes.size());
+    long run_steps = std::min(max_run_steps, std::max(1000L, 10L * (long) free_nodes.size()));
+    long run_end = run_steps;
+    int runs = 0;
+    double cooling = std::pow(end_temperature / start_temperature, 1.0 / (double) run_steps);
+    double temperature = start_temperature;
+
+    int step = 0;
+    for (; step < max_steps && !free_nodes.empty(); step++) {
+        if (step % control_chunk == 0 && control.stop_requested())
+            break;
+        if (step == run_end) {
+            // reheats from the best state, while every few runs the search starts over from a new sample
+            if (++runs % 8 == 0) {
+                current = restart(states);
+                if (current.better_than(best)) {
+                    best = current;
+                    best_states = states;
+                }
             } else {
-                query = node.get_name() + "|" + evidence;
-                // if someone wants to add support for more algorithms in the future, he can just insert them here (maybe with a switch case)
-                if (algorithm == 0) {
-                    posteriors = likelihood_weighting(query, num_samples);
-                } else {
-                    posteriors = rejection_sampling(query, num_samples);
+                states = best_states;
+                current = best;
+            }
+            run_steps = std::min(max_run_steps, 2 * run_steps);
+            run_end = step + run_steps;
+            cooling = std::pow(end_temperature / start_temperature, 1.0 / (double) run_steps);
+            temperature = start_temperature;
+        }
+
+        int node = free_nodes[std::uniform_int_distribution<size_t>(0, free_nodes.size() - 1)(engine)];
+        int n_states = (int) node_list[node].get_n_states();
+
+        // the deterministic descendants reached through deterministic nodes without evidence
+        changed.assign(1, node);
+        mark[node] = step;
+        for (size_t k = 0; k < changed.size(); k++)
+            for (int child : children[changed[k]])
+                if (mark[child] != step && observed[child] < 0 && node_list[child].is_deterministic()) {
+                    mark[child] = step;
+                    changed.push_back(child);
+                }
+        std::sort(changed.begin() + 1, changed.end()); // topological order
+        families = changed;
+        for (int c : changed)
+            for (int child : children[c])
+                if (mark[child] != step) {
+                    mark[child] = step;
+                    families.push_back(child);
                 }
+
+        auto set_state = [&](int state) {
+            states[node] = state;
+            for (size_t k = 1; k < changed.size(); k++)
+                states[changed[k]] = view(changed[k]).resulting_states()[view(changed[k]).row(states.data())];
+        };
+
+        // score of the families that depend on the node, for each of its states
+        int old_state = states[node];
+        candidates.assign(n_states, Score());
+        for (int state = 0; state < n_states; state++) {
+            set_state(state);
+            for (int f : families)
+                candidates[state].add(family_probability(f, states), 1);
+        }
+
+        // heat bath: among the states with the fewest impossible families, a state is chosen with probability
+        // proportional to exp(log probability / temperature), which tends to the best one as the temperature drops
+        int best_candidate = 0;
+        for (int state = 1; state < n_states; state++)
+            if (candidates[state].better_than(candidates[best_candidate]))
+                best_candidate = state;
+        weights.assign(n_states, 0);
+        double total = 0;
+        for (int state = 0; state < n_states; state++) {
+            if (candidates[state].zeros == candidates[best_candidate].zeros)
+                weights[state] = std::exp((candidates[state].log - candidates[best_candidate].log) / temperature);
+            total += weights[state];
+        }
+        double u = uniform(engine) * total;
+        int state = best_candidate;
+        for (int s = 0; s < n_states; s++) {
+            if (weights[s] > 0 && u < weights[s]) {
+                state = s;
+                break;
             }
-            results[query] = posteriors;
-        } catch (const std::invalid_argument& e) {
-            std::cerr << "Error: " << e.what() << "\n";
-            break;
+            u -= weights[s];
+        }
+
+        set_state(state);
+        current.zeros += candidates[state].zeros - candidates[old_state].zeros;
+        current.log += candidates[state].log - candidates[old_state].log;
+        if (current.better_than(best)) {
+            best = current;
+            best_states = states;
+        }
+        temperature *= cooling;
+    }
+
+    Explanation explanation;
+    for (int i = 0; i < node_list.size(); i++)
+        if (observed[i] < 0)
+            explanation.assignment.push_back({i, best_states[i]});
+    explanation.log_probability = best.zeros > 0 ? -std::numeric_limits<double>::infinity() : best.log;
+    explanation.steps = step;
+    return explanation;
+}
+
+double baynet::Graph::family_probability(int index, const std::vector<int>& states) const {
+    return row_probability(index, view(index).row(states.data()), states[index]);
+}
+
+double baynet::Graph::row_probability(int index, size_t row, int state) const {
+    thread_local std::vector<float> cond_probs; // distribution of the noisy-MAX nodes
+
+    NodeView node = view(index);
+    if (node.is_deterministic())
+        return node.resulting_states()[row] == state ? 1 : 0;
+    if (node.is_quantized())
+        return node.quantized().probability(row, state);
+    if (node.is_noisy_max()) {
+        cond_probs.resize(node.n_states());
+        node.noisy_max().distribution(row, cond_probs.data());
+        return cond_probs[state];
+    }
+    return node.cpt()[row][state];
+}
+
+std::vector<Factor> baynet::Graph::node_factors(int index, int& next_aux) {
+    const Node& node = node_list[index];
+    if (node.is_noisy_max()) {
+        // sequential decomposition of Y = max(L, Y_1, ..., Y_n): Z_0 = L, Z_i = max(Z_i-1, Y_i) and Y = Z_n.
+        // Each parent gives a factor over X_i, Z_i-1 and Z_i, so the size is linear in the number of parents
+        const NoisyMax& noisy = node.get_noisy_max();
+        size_t n = noisy.get_n_states();
+        std::vector<Factor> factors;
+        int prev = node.get_parents().empty() ? index : next_aux++;
+        std::vector<double> leak(n);
+        for (int y = 0; y < n; y++)
+            leak[y] = noisy.leak(y);
+        factors.push_back(Factor::from_table({prev}, {n}, leak));
+
+        for (int i = 0; i < node.get_parents().size(); i++) {
+            int parent = node.get_parents()[i];
+            size_t card = noisy.get_parent_cards()[i];
+            int z = i + 1 == node.get_parents().size() ? index : next_aux++;
+            // lower indexes are more severe: Z_i takes the smaller index between Z_i-1 and Y_i
+            std::vector<double> table(card * n * n, 0);
+            for (int x = 0; x < card; x++) {
+                for (int z_prev = 0; z_prev < n; z_prev++) {
+                    double tail = 0; // P(Y_i >= z_prev)
+                    for (int y = z_prev; y < n; y++)
+                        tail += noisy.link(i, x, y);
+                    for (int y = 0; y < z_prev; y++)
+                        table[(x * n + z_prev) * n + y] = noisy.link(i, x, y);
+                    table[(x * n + z_prev) * n + z_prev] = tail;
+                }
+            }
+            factors.push_back(Factor::from_table({parent, prev, z}, {card, n, n}, table));
+            prev = z;
         }
+        return factors;
+    }
+
+    std::vector<int> vars;
+    std::vector<size_t> cards;
+    for (int parent : node.get_parents()) {
+        vars.push_back(parent);
+        cards.push_back(node_list[parent].get_n_states());
+    }
+    vars.push_back(index);
+    cards.push_back(node.get_n_states());
+
+    // the cpt has a row for each configuration of the parents (last parent changes fastest) and a column for each state
+    std::vector<double> table;
+    if (node.is_deterministic()) {
+        const ResultingStates& resulting = node.get_resulting_states();
+        table.assign(resulting.size() * cards.back(), 0);
+        for (size_t row = 0; row < resulting.size(); row++)
+            table[row * cards.back() + resulting[row]] = 1;
+    } else if (node.is_quantized()) {
+        const QuantizedCpt& quantized = node.get_quantized();
+        for (size_t row = 0; row < quantized.get_n_rows(); row++)
+            for (int s = 0; s < cards.back(); s++)
+                table.push_back(quantized.probability(row, s));
+    } else {
+        for (const auto& row : view(index).cpt())
+            for (int s = 0; s < cards.back(); s++)
+                table.push_back(s < row.size() ? row[s] : 0);
+    }
+
+    return {Factor::from_table(vars, cards, table)};
+}
+
+baynet::NodeId baynet::Graph::resolve_node(std::string_view name) const {
+    int index = get_node_index(name);
+    if (index < 0)
+        throw std::invalid_argument("Invalid node name.");
+    return index;
+}
+
+baynet::StateId baynet::Graph::resolve_state(NodeId node, std::string_view state) const {
+    if (node < 0 || node >= node_list.size())
+        throw std::invalid_argument("Invalid node id.");
+    int index = node_list[node].get_state_index(state);
+    if (index < 0)
+        throw std::invalid_argument("Invalid evidence state.");
+    return index;
+}
+
+std::vector<baynet::EvidenceItem> baynet::Graph::resolve_evidence(const std::string& evidence) const {
+    BAYNET_STATS(StatsTimer parsing_timer(stats_collector.evidence_parsing_ns);)
+    std::vector<EvidenceItem> items;
+    if (evidence.empty())
+        return items;
+    for (const std::string& ev : utils::split_string(evidence, ',')) {
+        std::vector<std::string> tok = utils::split_string(ev, '=');
+        int node = tok.empty() ? -1 : get_node_index(tok[0]);
+        if (node < 0)
+            throw std::invalid_argument("Invalid evidence name.");
+        if (tok.size() < 2)
+            throw std::invalid_argument("Invalid evidence state.");
+        items.push_back({node, resolve_state(node, tok[1])});
     }
+    return items;
+}
 
+std::vector<int> baynet::Graph::evidence_states(std::span<const EvidenceItem> evidence) const {
+    std::vector<int> states(node_list.size(), -1);
+    for (const EvidenceItem& e : evidence) {
+        if (e.node < 0 || e.node >= node_list.size())
+            throw std::invalid_argument("Invalid evidence node.");
+        if (e.state < 0 || e.state >= node_list[e.node].get_n_states())
+            throw std::invalid_argument("Invalid evidence state.");
+        states[e.node] = e.state;
+    }
+    return states;
+}
+
+int baynet::Graph::get_node_index(std::string_view name) const {
+    uint32_t id = symbols->find(name);
+    return id == SymbolTable::npos || id >= symbol_nodes.size() ? -1 : symbol_nodes[id];
+}
+
+const std::vector<std::string>& baynet::Graph::skipped_nodes() const {
+    return skipped;
+}
+
+NodeView baynet::Graph::view(int index) const {
+    return NodeView(node_list[index]);
+}
+
+NodeView baynet::Graph::view(std::string_view name) const {
+    int index = get_node_index(name);
+    if (index < 0)
+        throw std::invalid_argument("Invalid node name.");
+    return view(index);
+}
+
+std::unordered_map<std::string, std::vector<float>> baynet::Graph::inference(int num_samples, const std::string& evidence, int algorithm) {
+    BAYNET_TRACE_SCOPE("inference");
+    std::unordered_map<std::string, std::vector<float>> results;
+    try {
+        results = all_nodes_inference(num_samples, evidence, algorithm);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+    }
+    return results;
+}
+
+std::unordered_map<std::string, baynet::QueryResult> baynet::Graph::inference(int num_samples, const std::string& evidence, int algorithm,
+                                                                             const QueryControl& control) {
+    BAYNET_TRACE_SCOPE("inference");
+    std::unordered_map<std::string, QueryResult> results;
+    try {
+        std::vector<QueryResult> posteriors = inference(resolve_evidence(evidence), num_samples, algorithm, control);
+        for (int i = 0; i < node_list.size(); i++)
+            results[std::string(node_list[i].get_name()) + (evidence.empty() ? "" : "|" + evidence)] = std::move(posteriors[i]);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+    }
+    return results;
+}
+
+std::vector<baynet::QueryResult> baynet::Graph::inference(std::span<const EvidenceItem> evidence, int num_samples, int algorithm,
+                                                          const QueryControl& control) {
+    BAYNET_TRACE_SCOPE("inference");
+    std::vector<QueryResult> results;
+    results.reserve(node_list.size());
+    for (int i = 0; i < node_list.size(); i++)
+        results.push_back(single_node_inference(i, evidence, num_samples, algorithm, control));
     return results;
 }
 
+std::unordered_map<std::string, std::vector<float>> baynet::Graph::all_nodes_inference(int num_samples, const std::string& evidence, int algorithm) {
+    std::unordered_map<std::string, std::vector<float>> results;
+    // the evidence is resolved once for all the nodes
+    std::vector<EvidenceItem> items = resolve_evidence(evidence);
+    for (int i = 0; i < node_list.size(); i++) {
+        std::string query = std::string(node_list[i].get_name());
+        if (!evidence.empty())
+            query += "|" + evidence;
+        results[query] = single_node_inference(i, items, num_samples, algorithm);
+    }
+    return results;
+}
+
+std::vector<float> baynet::Graph::single_node_inference(NodeId query, std::span<const EvidenceItem> evidence, int num_samples, int algorithm) {
+    if (query < 0 || query >= node_list.size())
+        throw std::invalid_argument("Invalid query node.");
+    return run_query({query}, evidence, num_samples, algorithm, nullptr).probabilities;
+}
+
+baynet::QueryResult baynet::Graph::single_node_inference(NodeId query, std::span<const EvidenceItem> evidence, int num_samples, int algorithm,
+                                                         const QueryControl& control) {
+    if (query < 0 || query >= node_list.size())
+        throw std::invalid_argument("Invalid query node.");
+    return run_query({query}, evidence, num_samples, algorithm, &control);
+}
+
+baynet::QueryResult baynet::Graph::run_query(const std::vector<int>& query, std::span<const EvidenceItem> evidence, int num_samples,
+                                             int algorithm, const QueryControl* control) {
+    check_algorithm(algorithm);
+    std::vector<int> states = evidence_states(evidence);
+
+    // without evidence the samplers only need to draw the prior
+    if (evidence.empty() && algorithm != 2)
+        return forward_sampling(query, num_samples, control);
+    // to add support for more algorithms, insert them here and in check_algorithm
+    switch (algorithm) {
+        case 0:
+            return likelihood_weighting(query, states, num_samples, control);
+        case 1:
+            return rejection_sampling(query, states, num_samples, control);
+        case 2:
+            return {variable_elimination(query, states)};
+        default:
+            throw std::invalid_argument("Unknown algorithm " + std::to_string(algorithm) + ".");
+    }
+}
+
+void baynet::Graph::check_algorithm(int algorithm) {
+    if (algorithm < 0 || algorithm > 2)
+        throw std::invalid_argument("Unknown algorithm " + std::to_string(algorithm) + ".");
+}
+
+std::vector<int> baynet::Graph::joint_query(std::span<const NodeId> query) const {
+    std::vector<int> nodes;
+    size_t size = 1;
+    for (NodeId node : query) {
+        if (node < 0 || node >= node_list.size())
+            throw std::invalid_argument("Invalid query node.");
+        if (std::find(nodes.begin(), nodes.end(), node) != nodes.end())
+            throw std::invalid_argument("Repeated query node.");
+        nodes.push_back(node);
+        size *= node_list[node].get_n_states();
+        if (size > max_joint_states)
+            throw std::invalid_argument("Joint query too large.");
+    }
+    if (nodes.empty())
+        throw std::invalid_argument("Empty query.");
+    return nodes;
+}
+
+std::vector<float> baynet::Graph::joint_inference(std::span<const NodeId> query, std::span<const EvidenceItem> evidence, int num_samples,
+                                                  int algorithm) {
+    BAYNET_TRACE_SCOPE("joint_inference");
+    return run_query(joint_query(query), evidence, num_samples, algorithm, nullptr).probabilities;
+}
+
+baynet::QueryResult baynet::Graph::joint_inference(std::span<const NodeId> query, std::span<const EvidenceItem> evidence, int num_samples,
+                                                   int algorithm, const QueryControl& control) {
+    BAYNET_TRACE_SCOPE("joint_inference");
+    return run_query(joint_query(query), evidence, num_samples, algorithm, &control);
+}
+
+template <typename F>
+auto baynet::Graph::submit_query(F query) -> std::future<std::invoke_result_t<F&>> {
+    {
+        std::lock_guard<std::mutex> lock(queries_mutex);
+        pending_queries++;
+    }
+    // the result is stored before the count is lowered, so that the futures are ready once the destructor returns
+    auto promise = std::make_shared<std::promise<std::invoke_result_t<F&>>>();
+    std::future<std::invoke_result_t<F&>> result = promise->get_future();
+    pool->submit([this, query = std::move(query), promise]() mutable {
+        try {
+            promise->set_value(query());
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+        std::lock_guard<std::mutex> lock(queries_mutex);
+        if (--pending_queries == 0)
+            queries_done.notify_all(); // under the lock: the destructor may release the graph right after
+    });
+    return result;
+}
+
+std::future<std::vector<float>> baynet::Graph::single_node_inference_async(NodeId query, std::vector<EvidenceItem> evidence,
+                                                                           int num_samples, int algorithm) {
+    // the query waits for its sampling tasks with ThreadPool::wait, which runs queued tasks meanwhile: the pool can not run
+    // out of workers even when every worker holds a query
+    return submit_query([this, query, evidence = std::move(evidence), num_samples, algorithm] {
+        return single_node_inference(query, evidence, num_samples, algorithm);
+    });
+}
+
+std::future<baynet::QueryResult> baynet::Graph::single_node_inference_async(NodeId query, std::vector<EvidenceItem> evidence, int num_samples,
+                                                                            int algorithm, QueryControl control) {
+    return submit_query([this, query, evidence = std::move(evidence), num_samples, algorithm, control] {
+        return single_node_inference(query, evidence, num_samples, algorithm, control);
+    });
+}
+
+std::future<std::vector<float>> baynet::Graph::single_node_inference_async(const std::string& query, int num_samples, int algorithm) {
+    return submit_query([this, query, num_samples, algorithm] {
+        BAYNET_TRACE_SCOPE("single_node_inference");
+        auto [query_node, evidence] = resolve_query(query);
+        return single_node_inference(query_node, evidence, num_samples, algorithm);
+    });
+}
+
+std::future<std::unordered_map<std::string, std::vector<float>>> baynet::Graph::inference_async(int num_samples, const std::string& evidence,
+                                                                                                int algorithm) {
+    return submit_query([this, num_samples, evidence, algorithm] {
+        BAYNET_TRACE_SCOPE("inference");
+        return all_nodes_inference(num_samples, evidence, algorithm);
+    });
+}
+
 void baynet::Graph::pretty_print(const std::unordered_map<std::string, std::vector<float>>& map) {
     for (auto& el : map) {
         std::cout << "P(" << el.first << ") = <";
@@ -465,33 +1905,85 @@ void baynet::Graph::pretty_print_query(const std::vector<float>& results, const
 
 void baynet::Graph::print_map() {
     std::cout<< "----------HashMap----------";
-    for (auto& e : Node::probs_hashmap) {
-        std::cout<<"\nCPT count: "<<e.second.use_count()<<std::endl;
-        for (auto& row : *e.second) {
+    cpt_store->for_each([](const std::string& hash, const CptStore::Entry& entry) {
+        std::cout<<"\nHash: "<<hash<<"\nCPT count: "<<entry.probabilities.use_count()<<std::endl;
+        for (auto& row : *entry.probabilities) {
             for (auto& el : row) {
                 std::cout << el << " ";
             }
             std::cout<<std::endl;
         }
-    }
+    });
     std::cout << "-------------------------"<<std::endl;
 }
 
+void baynet::Graph::set_num_threads(int num_threads) {
+    n_threads = std::max(1, num_threads);
+    if (pool->size() != n_threads)
+        pool = std::make_shared<ThreadPool>(n_threads);
+}
+
+int baynet::Graph::get_num_threads() const {
+    return n_threads;
+}
+
+void baynet::Graph::set_rounding(bool enabled) {
+    round_results = enabled;
+}
+
+baynet::Stats baynet::Graph::stats() const {
+#ifdef BAYNET_ENABLE_STATS
+    return stats_collector.snapshot();
+#else
+    return {};
+#endif
+}
+
+void baynet::Graph::reset_stats() {
+    BAYNET_STATS(stats_collector.reset();)
+}
+
 size_t baynet::Graph::get_map_size() {
-    return Node::probs_hashmap.size();
+    return cpt_store->size();
+}
+
+long baynet::Graph::get_cpt_count(const std::string& hashed_cpt) const {
+    return cpt_store->use_count(hashed_cpt);
+}
+
+const std::shared_ptr<CptStore>& baynet::Graph::get_cpt_store() const {
+    return cpt_store;
 }
 
 std::vector<float> baynet::Graph::single_node_inference(const std::string &query, int num_samples, int algorithm) {
+    BAYNET_TRACE_SCOPE("single_node_inference");
     std::vector<float> posteriors;
     try {
-        if (algorithm == 0) {
-            posteriors = likelihood_weighting(query, num_samples);
-        } else {
-            posteriors = rejection_sampling(query, num_samples);
-        }
+        auto [query_node, evidence] = resolve_query(query);
+        posteriors = single_node_inference(query_node, evidence, num_samples, algorithm);
     } catch (const std::invalid_argument& e) {
         std::cerr << "Error: " << e.what() << "\n";
     }
     return posteriors;
 }
 
+baynet::QueryResult baynet::Graph::single_node_inference(const std::string& query, int num_samples, int algorithm, const QueryControl& control) {
+    BAYNET_TRACE_SCOPE("single_node_inference");
+    QueryResult result;
+    try {
+        auto [query_node, evidence] = resolve_query(query);
+        result = single_node_inference(query_node, evidence, num_samples, algorithm, control);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+    }
+    return result;
+}
+
+
+std::pair<baynet::NodeId, std::vector<baynet::EvidenceItem>> baynet::Graph::resolve_query(const std::string& query) const {
+    std::vector<std::string> tokens = utils::split_string(query, '|');
+    NodeId query_node = tokens.empty() ? -1 : get_node_index(tokens[0]);
+    if (query_node < 0)
+        throw std::invalid_argument("Invalid query name.");
+    return {query_node, resolve_evidence(tokens.size() > 1 ? tokens[1] : "")};
+}
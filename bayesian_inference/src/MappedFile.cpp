@@ -0,0 +1,86 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) {
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Can not open " + filename);
+
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Can not read " + filename);
+    }
+    size = (size_t) file_size.QuadPart;
+
+    if (size > 0) { // an empty file can not be mapped
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* ptr = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (mapping != nullptr)
+            CloseHandle(mapping); // the view keeps the mapping alive
+        if (ptr == nullptr) {
+            CloseHandle(file);
+            throw std::runtime_error("Can not map " + filename);
+        }
+        data = (const char*) ptr;
+    }
+    CloseHandle(file);
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Can not open " + filename);
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Can not read " + filename);
+    }
+    size = (size_t) st.st_size;
+
+    if (size > 0) {
+        void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Can not map " + filename);
+        }
+        data = (const char*) ptr;
+        madvise(ptr, size, MADV_SEQUENTIAL); // the file is read front to back
+    }
+    close(fd); // the mapping stays valid after closing the descriptor
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr)
+        munmap((void*) data, size);
+}
+
+#endif
+
+std::string_view MappedFile::view() const {
+    return {data, size};
+}
@@ -0,0 +1,29 @@
+#ifndef BAYESIANNETWORKS_MAPPEDFILE_H
+#define BAYESIANNETWORKS_MAPPEDFILE_H
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/*
+ * Read-only memory mapping of a whole file (mmap on POSIX systems, a file mapping on Windows).
+ * The content is paged in by the OS on access, so reading a big network never copies it in a buffer.
+ */
+class MappedFile {
+public:
+    //maps the file, throws std::runtime_error if it can not be opened
+    explicit MappedFile(const std::string& filename);
+
+    ~MappedFile();
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    //returns the content of the file
+    std::string_view view() const;
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+#endif //BAYESIANNETWORKS_MAPPEDFILE_H
@@ -0,0 +1,83 @@
+#include "baynet/NetworkRegistry.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+baynet::NetworkRegistry::NetworkRegistry() : store(std::make_shared<CptStore>()) {}
+
+std::shared_ptr<baynet::Graph> baynet::NetworkRegistry::load(const std::string& name, const std::string& filename, const LoadOptions& options) {
+    BAYNET_TRACE_SCOPE("NetworkRegistry::load");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (graphs.find(name) != graphs.end())
+            throw std::invalid_argument("Network " + name + " is already loaded.");
+    }
+    // loaded outside of the lock, so that several networks can be loaded at the same time
+    auto graph = std::make_shared<Graph>(filename, options, store);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!graphs.emplace(name, graph).second)
+        throw std::invalid_argument("Network " + name + " is already loaded.");
+    return graph;
+}
+
+std::shared_ptr<baynet::Graph> baynet::NetworkRegistry::get(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = graphs.find(name);
+    if (it == graphs.end())
+        throw std::invalid_argument("Unknown network " + name + ".");
+    return it->second;
+}
+
+bool baynet::NetworkRegistry::contains(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return graphs.find(name) != graphs.end();
+}
+
+void baynet::NetworkRegistry::unload(const std::string& name) {
+    std::shared_ptr<Graph> graph;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = graphs.find(name);
+        if (it == graphs.end())
+            throw std::invalid_argument("Unknown network " + name + ".");
+        graph = std::move(it->second);
+        graphs.erase(it);
+    }
+    // if nobody else holds it, the graph is destroyed here, outside of the lock
+}
+
+std::vector<std::string> baynet::NetworkRegistry::names() const {
+    std::vector<std::string> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& g : graphs)
+            result.push_back(g.first);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+baynet::RegistryMemory baynet::NetworkRegistry::memory() const {
+    std::vector<std::shared_ptr<Graph>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& g : graphs)
+            loaded.push_back(g.second);
+    }
+
+    RegistryMemory result;
+    for (const auto& graph : loaded) {
+        // the nodes of a graph with the same cpt share it even without the store: each cpt is counted once per graph
+        std::unordered_set<const void*> counted;
+        for (const Node& node : graph->node_list) {
+            if (node.get_hashed_cpt().empty())
+                continue;
+            CptStore::Entry entry = store->find(node.get_hashed_cpt());
+            if (counted.insert(entry.probabilities.get()).second)
+                result.cpt_bytes += CptStore::memory(entry);
+        }
+    }
+    result.unique_cpt_bytes = store->memory();
+    result.unique_cpts = store->size();
+    return result;
+}
@@ -5,50 +5,108 @@
 #include <sha1.h>
 #include "Node.h"
 
-std::string Node::get_name() const {
-    return name;
+std::string_view Node::get_name() const {
+    return symbols->name(name);
 }
 
-std::unordered_map<std::string, int> Node::get_states_map() const {
-    return states_map;
+int Node::get_state_index(std::string_view state) const {
+    uint32_t id = symbols->find(state);
+    for (int i = 0; i < states.size(); i++)
+        if (states[i] == id)
+            return i;
+    return -1;
 }
 
-std::vector<std::string> Node::get_states() const {
-    return states;
+std::string_view Node::get_state(int index) const {
+    return symbols->name(states[index]);
 }
 
+size_t Node::get_n_states() const {
+    return states.size();
+}
 
-
-std::vector<std::string> Node::get_parents() const {
+const std::vector<int>& Node::get_parents() const {
     return parents;
 }
 
-std::string Node::hash_fun(const std::string& h) {
+std::string Node::hash_fun(std::string_view h) {
 
     Chocobo1::SHA1 hash;
-    hash.addData(h.c_str(), h.size()).finalize();
+    hash.addData(h.data(), h.size()).finalize();
     return hash.toString();
 }
 
-void Node::set_probabilities(const std::shared_ptr<std::vector<std::vector<float>>> &probabilities, const std::string& hashedCpt) {
+void Node::set_probabilities(const std::shared_ptr<std::vector<std::vector<float>>> &probabilities, const std::string& hashedCpt,
+                             std::shared_ptr<const CumulativeCpt> cumulative) {
     this->m_ptr = probabilities;
+    this->cumulative_cpt = cumulative ? std::move(cumulative) : std::make_shared<const CumulativeCpt>(*probabilities);
     this->hashedCPT = hashedCpt; // the new hash
+    this->resulting_states.reset();
+    this->noisy_max.reset();
+    this->quantized_cpt.reset();
     //    std::cout<<"Number of pointers: "<<probabilities.use_count()<<std::endl;
 }
 
-void Node::probs_check_delete(const std::string& hashedCPT) {
-    if (Node::probs_hashmap[hashedCPT].use_count() == 1) {
-        Node::probs_hashmap[hashedCPT].reset();
-        Node::probs_hashmap.erase(hashedCPT);
-    }
+void Node::set_resulting_states(std::shared_ptr<const ResultingStates> resulting) {
+    this->resulting_states = std::move(resulting);
+    this->cumulative_cpt.reset();
+    this->noisy_max.reset();
+    this->quantized_cpt.reset();
+    this->m_ptr.reset();
+    this->hashedCPT.clear();
+}
+
+const CumulativeCpt& Node::get_cumulative() const {
+    return *cumulative_cpt;
+}
+
+bool Node::is_deterministic() const {
+    return resulting_states != nullptr;
+}
+
+const ResultingStates& Node::get_resulting_states() const {
+    return *resulting_states;
+}
+
+void Node::set_noisy_max(std::shared_ptr<const NoisyMax> noisy) {
+    this->noisy_max = std::move(noisy);
+    this->cumulative_cpt.reset();
+    this->resulting_states.reset();
+    this->quantized_cpt.reset();
+    this->m_ptr.reset();
+    this->hashedCPT.clear();
+}
+
+bool Node::is_noisy_max() const {
+    return noisy_max != nullptr;
+}
+
+const NoisyMax& Node::get_noisy_max() const {
+    return *noisy_max;
+}
+
+void Node::set_quantized(std::shared_ptr<const QuantizedCpt> quantized) {
+    this->quantized_cpt = std::move(quantized);
+    this->cumulative_cpt.reset();
+    this->resulting_states.reset();
+    this->noisy_max.reset();
+    this->m_ptr.reset();
+    this->hashedCPT.clear();
+}
+
+bool Node::is_quantized() const {
+    return quantized_cpt != nullptr;
+}
 
+const QuantizedCpt& Node::get_quantized() const {
+    return *quantized_cpt;
 }
 
 std::string Node::get_hashed_cpt() const {
     return hashedCPT;
 }
 
-std::vector<unsigned int> Node::get_parent_weight_states() const {
+const std::vector<unsigned int>& Node::get_parent_weight_states() const {
     return parent_wstates;
 }
 
@@ -3,62 +3,131 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
+#include <stdexcept>
 #include <utility>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <memory>
 #include "COWBase.h"
+#include "NoisyMax.h"
+#include "QuantizedCpt.h"
+#include "CumulativeCpt.h"
+#include "SymbolTable.h"
+
+/*
+ * Resulting state of a deterministic node for each configuration of the parents.
+ * The indexes are stored in one byte when the node has at most 256 states, in two bytes otherwise
+ */
+class ResultingStates {
+public:
+    inline ResultingStates(const std::vector<int>& indexes, size_t n_states) {
+        if (n_states > 65536)
+            throw std::runtime_error("Too many states for a deterministic node.");
+        if (n_states <= 256)
+            narrow.assign(indexes.begin(), indexes.end());
+        else
+            wide.assign(indexes.begin(), indexes.end());
+    }
+
+    //returns the index of the resulting state for the given row (configuration of the parents)
+    inline int operator[](size_t row) const {
+        return narrow.empty() ? wide[row] : narrow[row];
+    }
+
+    //returns the number of rows
+    inline size_t size() const {
+        return narrow.empty() ? wide.size() : narrow.size();
+    }
+
+private:
+    std::vector<uint8_t> narrow;
+    std::vector<uint16_t> wide;
+};
 
 class Node : public COWBase<std::vector<std::vector<float>>>{
 public:
-    //constructor
-    explicit inline Node(std::string name, std::vector<std::string> states, std::unordered_map<std::string, int> states_map,
-                  std::shared_ptr<std::vector<std::vector<float>>> probabilities, std::vector<std::string> parents,
+    //constructor: name and states are ids of the symbol table of the graph, parents are indexes of the graph's node_list
+    explicit inline Node(const SymbolTable* symbols, uint32_t name, std::vector<uint32_t> states,
+                  std::shared_ptr<std::vector<std::vector<float>>> probabilities, std::vector<int> parents,
                   std::string hashedCPT, std::vector<unsigned int> parent_wstates)
 
-            : name(std::move(name)), states(std::move(states)), states_map(std::move(states_map)),
+            : symbols(symbols), name(name), states(std::move(states)),
             parents(std::move(parents)), hashedCPT(std::move(hashedCPT)), parent_wstates(std::move(parent_wstates))
             {this->m_ptr=std::move((probabilities));};
 
 
-    //returns node's name
-    std::string get_name() const;
+    //returns node's name (it lives as long as the graph)
+    std::string_view get_name() const;
 
     //given a string it returns the sha1 hash of the string.
-    static std::string hash_fun(const std::string& h);
+    static std::string hash_fun(std::string_view h);
 
-    //return states_map, a map where the key is the name of the state, and the value is the index of the state (used for indexing the cpt)
-    std::unordered_map<std::string, int> get_states_map() const;
+    //returns the index of the state with the given name (used for indexing the cpt), -1 if the node has no such state
+    int get_state_index(std::string_view state) const;
 
-    //return states
-    std::vector<std::string> get_states() const;
+    //returns the name of the state with the given index (it lives as long as the graph)
+    std::string_view get_state(int index) const;
 
-    //given a key it set the probability for the node
-    void set_probabilities(const std::shared_ptr<std::vector<std::vector<float>>>& probabilities, const std::string& hashedCpt);
+    //returns the number of states
+    size_t get_n_states() const;
 
-    //returns the parents
-    std::vector<std::string> get_parents() const;
+    //given a key it set the probability for the node. A deterministic, noisy-MAX or quantised node becomes a regular one.
+    //cumulative are the prefix sums of the probabilities, compiled here if not given
+    void set_probabilities(const std::shared_ptr<std::vector<std::vector<float>>>& probabilities, const std::string& hashedCpt,
+                           std::shared_ptr<const CumulativeCpt> cumulative = nullptr);
 
-    //return the key for the probs_hashmap
-    std::string get_hashed_cpt() const;
+    //returns the prefix sums of the float cpt, used for sampling
+    const CumulativeCpt& get_cumulative() const;
+
+    //makes the node deterministic: it has no cpt (nor hashed cpt), only a resulting state for each configuration of the parents
+    void set_resulting_states(std::shared_ptr<const ResultingStates> resulting);
+
+    //returns true if the node is deterministic
+    bool is_deterministic() const;
+
+    //returns the resulting states of a deterministic node
+    const ResultingStates& get_resulting_states() const;
 
-    //given an hashed cpt (a key of probs_hashmap) it checks if the reference counter is equal to 1.
-    //if it is, the cpt is deleted
-    static void probs_check_delete(const std::string& hashedCPT);
+    //makes the node a noisy-MAX one: it has no cpt (nor hashed cpt), only the link parameters of its parents
+    void set_noisy_max(std::shared_ptr<const NoisyMax> noisy);
+
+    //returns true if the node is a noisy-MAX one
+    bool is_noisy_max() const;
+
+    //returns the parameters of a noisy-MAX node
+    const NoisyMax& get_noisy_max() const;
+
+    //stores the cpt of the node as 16-bit cumulative distributions: it has no float cpt (nor hashed cpt)
+    void set_quantized(std::shared_ptr<const QuantizedCpt> quantized);
+
+    //returns true if the cpt of the node is quantised
+    bool is_quantized() const;
+
+    //returns the quantised cpt of the node
+    const QuantizedCpt& get_quantized() const;
+
+    //returns the indexes of the parents in the graph's node_list
+    const std::vector<int>& get_parents() const;
+
+    //return the key of the cpt in the cpt store of the graph (empty if the node has no float cpt)
+    std::string get_hashed_cpt() const;
 
     // vector that contains the product of the number of states of the next parents, for each parent (used for indexing the cpt)
-    std::vector<unsigned int> get_parent_weight_states() const;
+    const std::vector<unsigned int>& get_parent_weight_states() const;
 
-    // map that contains the unique CPTs, used for CoW
-    // key is the hashed string of probabilities, value is a shared_ptr to the CPT
-    static std::unordered_map<std::string, std::shared_ptr<std::vector<std::vector<float>>>> probs_hashmap;
 private:
-    std::string name; // name of the node
-    std::unordered_map<std::string,int> states_map; // state,index
-    std::vector<std::string> states; // list of the node's states
-    std::vector<std::string> parents; // list of the node's parents
-    std::string hashedCPT; // key of the probs_hashmap corresponding to this node's cpt
+    const SymbolTable* symbols; // names of the graph
+    uint32_t name; // symbol of the node's name
+    std::vector<uint32_t> states; // symbols of the node's states
+    std::vector<int> parents; // indexes of the node's parents
+    std::string hashedCPT; // key of the cpt store corresponding to this node's cpt
     std::vector<unsigned int> parent_wstates; // used for indexing the cpt
+    std::shared_ptr<const CumulativeCpt> cumulative_cpt; // prefix sums of the float cpt
+    std::shared_ptr<const ResultingStates> resulting_states; // only for deterministic nodes
+    std::shared_ptr<const NoisyMax> noisy_max; // only for noisy-MAX nodes
+    std::shared_ptr<const QuantizedCpt> quantized_cpt; // only for the nodes of graphs loaded with CptStorage::Fixed16
 };
 
 
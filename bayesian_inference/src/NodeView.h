@@ -0,0 +1,100 @@
+#ifndef BAYESIANNETWORKS_NODEVIEW_H
+#define BAYESIANNETWORKS_NODEVIEW_H
+#pragma once
+
+#include <span>
+#include <string_view>
+#include <vector>
+#include "Node.h"
+
+/*
+ * Read-only view of a node: names, parents and cpt are returned as string_views and spans into the node and the
+ * symbol table of its graph, nothing is copied. Used by the samplers, where a copy per sample is not affordable.
+ * A view is valid as long as the graph is alive; the spans into the cpt are invalidated by edit_cpt on the node
+ */
+class NodeView {
+public:
+    explicit inline NodeView(const Node& node) : node(&node) {}
+
+    //returns the name of the node
+    inline std::string_view name() const {
+        return node->get_name();
+    }
+
+    //returns the number of states
+    inline size_t n_states() const {
+        return node->get_n_states();
+    }
+
+    //returns the name of the state with the given index
+    inline std::string_view state(int index) const {
+        return node->get_state(index);
+    }
+
+    //returns the index of the state with the given name, -1 if the node has no such state
+    inline int state_index(std::string_view state) const {
+        return node->get_state_index(state);
+    }
+
+    //returns the indexes of the parents in the graph's node_list
+    inline std::span<const int> parents() const {
+        return node->get_parents();
+    }
+
+    //returns the product of the number of states of the next parents, for each parent
+    inline std::span<const unsigned int> parent_weights() const {
+        return node->get_parent_weight_states();
+    }
+
+    //returns the row of the cpt selected by the states of the parents, given the state of every node of the graph
+    inline size_t row(const int* states) const {
+        const std::vector<int>& parents = node->get_parents();
+        const std::vector<unsigned int>& weights = node->get_parent_weight_states();
+        size_t row = 0;
+        for (size_t i = 0; i < parents.size(); i++)
+            row += (size_t) states[parents[i]] * weights[i];
+        return row;
+    }
+
+    //returns the rows of the float cpt, empty for deterministic, noisy-MAX, quantised and not yet loaded nodes
+    inline std::span<const std::vector<float>> cpt() const {
+        const auto* probabilities = node->get();
+        if (!probabilities)
+            return {};
+        return *probabilities;
+    }
+
+    //returns the prefix sums of the float cpt
+    inline const CumulativeCpt& cumulative() const {
+        return node->get_cumulative();
+    }
+
+    inline bool is_deterministic() const {
+        return node->is_deterministic();
+    }
+
+    inline const ResultingStates& resulting_states() const {
+        return node->get_resulting_states();
+    }
+
+    inline bool is_noisy_max() const {
+        return node->is_noisy_max();
+    }
+
+    inline const NoisyMax& noisy_max() const {
+        return node->get_noisy_max();
+    }
+
+    inline bool is_quantized() const {
+        return node->is_quantized();
+    }
+
+    inline const QuantizedCpt& quantized() const {
+        return node->get_quantized();
+    }
+
+private:
+    const Node* node;
+};
+
+#endif //BAYESIANNETWORKS_NODEVIEW_H
@@ -0,0 +1,88 @@
+#include "NoisyMax.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    // tail[y] = sum of row[y..]: the probability of a state at most as severe as y
+    void fill_tails(const float* row, size_t n, float* tail) {
+        float sum = 0;
+        for (size_t y = n; y-- > 0;) {
+            sum += row[y];
+            tail[y] = sum;
+        }
+    }
+}
+
+NoisyMax::NoisyMax(size_t n_states, std::vector<size_t> parent_cards, const std::vector<int>& strengths,
+                   const std::vector<std::vector<float>>& parameters)
+    : n_states(n_states), parent_cards(std::move(parent_cards))
+{
+    size_t total_states = 0;
+    for (size_t card : this->parent_cards) {
+        offsets.push_back(total_states * n_states);
+        total_states += card;
+    }
+    if (strengths.size() != total_states)
+        throw std::runtime_error("Expected " + std::to_string(total_states) + " strengths, found " + std::to_string(strengths.size()) + ".");
+    if (parameters.size() != total_states + 1)
+        throw std::runtime_error("Expected " + std::to_string(total_states + 1) + " parameter rows, found " + std::to_string(parameters.size()) + ".");
+
+    links.assign(total_states * n_states, 0);
+    tails.assign(total_states * n_states, 0);
+    size_t row = 0;
+    for (size_t i = 0; i < this->parent_cards.size(); i++) {
+        std::vector<bool> seen(this->parent_cards[i], false);
+        for (size_t k = 0; k < this->parent_cards[i]; k++, row++) {
+            int x = strengths[row];
+            if (x < 0 || x >= this->parent_cards[i] || seen[x])
+                throw std::runtime_error("The strengths of parent " + std::to_string(i) + " are not a permutation of its states.");
+            seen[x] = true;
+            std::copy(parameters[row].begin(), parameters[row].end(), links.begin() + offsets[i] + x * n_states);
+        }
+    }
+    for (size_t r = 0; r < total_states; r++)
+        fill_tails(&links[r * n_states], n_states, &tails[r * n_states]);
+
+    leak_links = parameters.back();
+    leak_tails.resize(n_states);
+    fill_tails(leak_links.data(), n_states, leak_tails.data());
+}
+
+void NoisyMax::distribution(size_t row, float* out) const {
+    // P(Y >= y) is the product of the same probability for each parent and for the leak:
+    // the child is at most as severe as y only if all of them are. The tails are built in out, then differenced in place
+    std::copy(leak_tails.begin(), leak_tails.end(), out);
+    for (size_t i = parent_cards.size(); i-- > 0;) {
+        size_t x = row % parent_cards[i];
+        row /= parent_cards[i];
+        const float* parent_tail = &tails[offsets[i] + x * n_states];
+        for (size_t y = 0; y < n_states; y++)
+            out[y] *= parent_tail[y];
+    }
+    for (size_t y = 0; y + 1 < n_states; y++)
+        out[y] = std::max(0.0f, out[y] - out[y + 1]);
+}
+
+float NoisyMax::link(size_t parent, int x, int y) const {
+    return links[offsets[parent] + x * n_states + y];
+}
+
+float NoisyMax::leak(int y) const {
+    return leak_links[y];
+}
+
+size_t NoisyMax::get_n_states() const {
+    return n_states;
+}
+
+const std::vector<size_t>& NoisyMax::get_parent_cards() const {
+    return parent_cards;
+}
+
+size_t NoisyMax::n_rows() const {
+    size_t rows = 1;
+    for (size_t card : parent_cards)
+        rows *= card;
+    return rows;
+}
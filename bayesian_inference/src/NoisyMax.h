@@ -0,0 +1,54 @@
+#ifndef BAYESIANNETWORKS_NOISYMAX_H
+#define BAYESIANNETWORKS_NOISYMAX_H
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Noisy-MAX parametric cpt (noisy-OR is its binary case), as written by GeNIe in <noisymax> nodes.
+ * The states of the child are ordered from the most to the least severe, the last one being the distinguished (absent) state.
+ * Each parent i independently takes the child to a state Y_i with probability P(Y_i | X_i), the leak L gives the state of the
+ * child when all the parents are in their distinguished state, and the child takes the most severe of them: Y = max(Y_1, ..., Y_n, L).
+ * Only the link parameters are stored, so the size is linear in the number of parents instead of exponential
+ */
+class NoisyMax {
+public:
+    /*
+     * n_states: number of states of the child; parent_cards: number of states of each parent.
+     * strengths: for each parent, the permutation of its states in which the parameters are listed.
+     * parameters: for each parent and each of its states (in strengths order) a row with the distribution of the child, then the leak row.
+     * Throws std::runtime_error if the sizes do not match or the strengths are not permutations
+     */
+    NoisyMax(size_t n_states, std::vector<size_t> parent_cards, const std::vector<int>& strengths,
+             const std::vector<std::vector<float>>& parameters);
+
+    //writes in out (n_states values) the distribution of the child for a row of the equivalent cpt (last parent changes fastest)
+    void distribution(size_t row, float* out) const;
+
+    //returns P(Y_i = y | X_i = x): the probability that parent i alone, in state x, takes the child to state y
+    float link(size_t parent, int x, int y) const;
+
+    //returns the probability of state y of the leak
+    float leak(int y) const;
+
+    //returns the number of states of the child
+    size_t get_n_states() const;
+
+    //returns the number of states of each parent
+    const std::vector<size_t>& get_parent_cards() const;
+
+    //returns the number of rows of the equivalent cpt
+    size_t n_rows() const;
+
+private:
+    size_t n_states;
+    std::vector<size_t> parent_cards;
+    std::vector<size_t> offsets; // start of the rows of each parent in links and tails
+    std::vector<float> links; // P(Y_i = y | X_i = x) at offsets[i] + x * n_states + y, x being the index of the parent state
+    std::vector<float> tails; // P(Y_i >= y) in the index order (at most as severe as y), same layout as links
+    std::vector<float> leak_links;
+    std::vector<float> leak_tails;
+};
+
+#endif //BAYESIANNETWORKS_NOISYMAX_H
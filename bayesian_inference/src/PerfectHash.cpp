@@ -0,0 +1,64 @@
+#include "PerfectHash.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+PerfectHash::PerfectHash(std::vector<std::string_view> keys) : keys(std::move(keys)) {
+    size_t n = this->keys.size();
+    if (n == 0)
+        return;
+    seeds.assign(n / 4 + 1, 0); // about four keys for each bucket
+    slots.assign(n + n / 4 + 1, -1); // a few free slots keep the search of the seeds short
+
+    std::vector<uint64_t> hashes(n);
+    std::vector<std::vector<uint32_t>> buckets(seeds.size());
+    for (uint32_t i = 0; i < n; i++) {
+        hashes[i] = hash(this->keys[i]);
+        buckets[hashes[i] % seeds.size()].push_back(i);
+    }
+
+    // the largest buckets are placed first, while most of the slots are free
+    std::vector<size_t> order(buckets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    std::vector<size_t> taken;
+    for (size_t b : order) {
+        const std::vector<uint32_t>& bucket = buckets[b];
+        if (bucket.empty())
+            break;
+        for (size_t i = 0; i < bucket.size(); i++)
+            for (size_t j = i + 1; j < bucket.size(); j++)
+                if (this->keys[bucket[i]] == this->keys[bucket[j]])
+                    throw std::runtime_error("Duplicated key " + std::string(this->keys[bucket[i]]) + ".");
+
+        for (uint32_t seed = 1;; seed++) {
+            if (seed == 0)
+                throw std::runtime_error("Can not build the perfect hash.");
+            taken.clear();
+            for (uint32_t key : bucket) {
+                size_t s = slot(hashes[key], seed);
+                if (slots[s] >= 0 || std::find(taken.begin(), taken.end(), s) != taken.end())
+                    break;
+                taken.push_back(s);
+            }
+            if (taken.size() == bucket.size()) {
+                seeds[b] = seed;
+                for (size_t i = 0; i < bucket.size(); i++)
+                    slots[taken[i]] = (int32_t) bucket[i];
+                break;
+            }
+        }
+    }
+}
+
+uint64_t PerfectHash::hash(std::string_view key) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : key) {
+        h ^= (unsigned char) c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
@@ -0,0 +1,48 @@
+#ifndef BAYESIANNETWORKS_PERFECTHASH_H
+#define BAYESIANNETWORKS_PERFECTHASH_H
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/*
+ * Collision-free lookup table over a fixed set of distinct strings, built once (hash and displace).
+ * The keys are split into buckets by their hash; each bucket gets a seed such that all its keys land in free slots,
+ * so a lookup hashes the key once and compares it with a single candidate.
+ * The keys are not copied: the strings they view must outlive the table
+ */
+class PerfectHash {
+public:
+    PerfectHash() = default;
+
+    //builds the table. Throws std::runtime_error if a key is repeated
+    explicit PerfectHash(std::vector<std::string_view> keys);
+
+    //returns the position of the key in the vector given to the constructor, -1 if it is not one of the keys
+    inline int find(std::string_view key) const {
+        if (keys.empty())
+            return -1;
+        uint64_t h = hash(key);
+        int32_t index = slots[slot(h, seeds[h % seeds.size()])];
+        return index >= 0 && keys[index] == key ? index : -1;
+    }
+
+private:
+    static uint64_t hash(std::string_view key);
+
+    //slot of a key with hash h in a bucket with the given seed
+    inline size_t slot(uint64_t h, uint32_t seed) const {
+        uint64_t x = h ^ (seed * 0x9e3779b97f4a7c15ULL);
+        x ^= x >> 31;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 29;
+        return x % slots.size();
+    }
+
+    std::vector<std::string_view> keys;
+    std::vector<uint32_t> seeds; // one for each bucket
+    std::vector<int32_t> slots; // index of the key in each slot, -1 if the slot is empty
+};
+
+#endif //BAYESIANNETWORKS_PERFECTHASH_H
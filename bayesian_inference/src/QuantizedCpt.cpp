@@ -0,0 +1,36 @@
+#include "QuantizedCpt.h"
+#include <algorithm>
+#include <cmath>
+
+QuantizedCpt::QuantizedCpt(const std::vector<std::vector<float>>& probabilities)
+    : n_rows(probabilities.size()), n_states(probabilities.empty() ? 1 : probabilities.front().size())
+{
+    cumulative.reserve(probabilities.size() * (n_states - 1));
+    for (const auto& row : probabilities) {
+        double sum = 0;
+        for (float p : row)
+            sum += p;
+
+        double partial = 0;
+        for (size_t i = 0; i + 1 < n_states; i++) {
+            partial += row[i];
+            double value = sum > 0 ? partial / sum : 0;
+            cumulative.push_back((uint16_t) std::lround(std::min(value, 1.0) * scale));
+        }
+    }
+}
+
+float QuantizedCpt::probability(size_t row, int state) const {
+    const uint16_t* thresholds = cumulative.data() + row * (n_states - 1);
+    uint32_t upper = state + 1 < n_states ? thresholds[state] : scale;
+    uint32_t lower = state > 0 ? thresholds[state - 1] : 0;
+    return (float) (upper - lower) / (float) scale;
+}
+
+size_t QuantizedCpt::get_n_rows() const {
+    return n_rows;
+}
+
+size_t QuantizedCpt::get_n_states() const {
+    return n_states;
+}
@@ -0,0 +1,48 @@
+#ifndef BAYESIANNETWORKS_QUANTIZEDCPT_H
+#define BAYESIANNETWORKS_QUANTIZEDCPT_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Cpt stored as 16-bit fixed-point cumulative distributions (CptStorage::Fixed16).
+ * Each row is normalised, then the cumulative probability of every state but the last one is rounded to the nearest
+ * multiple of 1/65535 (the last one is implicitly 1). A state is sampled by comparing a uniform integer in [0, 65534]
+ * with the thresholds of the row, without going back to floats.
+ * Error bound: every probability differs from the normalised float value by at most 1/65535 (about 1.5e-5).
+ * States with probability 0 are never sampled, states with probability below 1/131070 may be rounded to 0.
+ * A row of n states takes 2 * (n - 1) bytes, instead of 4 * n plus the vector overhead
+ */
+class QuantizedCpt {
+public:
+    static constexpr uint32_t scale = 65535; // value of a cumulative probability of 1
+
+    explicit QuantizedCpt(const std::vector<std::vector<float>>& probabilities);
+
+    //returns the state of the row selected by the uniform integer u, in [0, scale)
+    inline int sample(size_t row, uint32_t u) const {
+        const uint16_t* thresholds = cumulative.data() + row * (n_states - 1);
+        int state = 0;
+        for (size_t i = 0; i + 1 < n_states; i++)
+            state += u >= thresholds[i]; // the thresholds are sorted: counts the ones not above u
+        return state;
+    }
+
+    //returns the (quantised) probability of a state in a row
+    float probability(size_t row, int state) const;
+
+    //returns the number of rows
+    size_t get_n_rows() const;
+
+    //returns the number of states
+    size_t get_n_states() const;
+
+private:
+    size_t n_rows;
+    size_t n_states;
+    std::vector<uint16_t> cumulative; // n_states - 1 thresholds for each row
+};
+
+#endif //BAYESIANNETWORKS_QUANTIZEDCPT_H
@@ -0,0 +1,105 @@
+#ifndef BAYESIANNETWORKS_STATS_H
+#define BAYESIANNETWORKS_STATS_H
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Hot-path counters of a Graph.
+ * They are collected only when the library is built with BAYNET_ENABLE_STATS (cmake -DBAYNET_ENABLE_STATS=ON),
+ * otherwise every BAYNET_STATS statement is removed by the preprocessor and Graph::stats() returns zeros.
+ */
+
+#ifdef BAYNET_ENABLE_STATS
+#define BAYNET_STATS(...) __VA_ARGS__
+#else
+#define BAYNET_STATS(...)
+#endif
+
+namespace baynet {
+
+    // snapshot of the counters, returned by Graph::stats()
+    struct Stats {
+        uint64_t samples_drawn = 0; // samples generated by all the sampling algorithms
+        uint64_t samples_rejected = 0; // samples discarded by rejection sampling
+        double effective_sample_size = 0; // (sum w)^2 / sum w^2 of the last likelihood weighting query
+        double evidence_parsing_seconds = 0; // parsing and validation of queries and evidence
+        double sampling_seconds = 0; // wall time from the start of the workers until all of them are done
+        double reduction_seconds = 0; // merge of the partial results of the workers
+        double normalization_seconds = 0;
+        uint64_t worker_tasks = 0; // worker tasks started
+        uint64_t max_queue_depth = 0; // maximum number of tasks waiting in the queue of the worker pool, sampled at each submission
+    };
+
+    // thread-safe accumulator of the counters
+    class StatsCollector {
+    public:
+        std::atomic<uint64_t> samples_drawn = 0;
+        std::atomic<uint64_t> samples_rejected = 0;
+        std::atomic<double> effective_sample_size = 0;
+        std::atomic<uint64_t> evidence_parsing_ns = 0;
+        std::atomic<uint64_t> sampling_ns = 0;
+        std::atomic<uint64_t> reduction_ns = 0;
+        std::atomic<uint64_t> normalization_ns = 0;
+        std::atomic<uint64_t> worker_tasks = 0;
+        std::atomic<uint64_t> max_queue_depth = 0;
+
+        //a worker task has been queued, leaving depth tasks in the queue of the pool
+        void task_queued(uint64_t depth) {
+            worker_tasks++;
+            uint64_t max = max_queue_depth.load();
+            while (depth > max && !max_queue_depth.compare_exchange_weak(max, depth));
+        }
+
+        Stats snapshot() const {
+            Stats s;
+            s.samples_drawn = samples_drawn;
+            s.samples_rejected = samples_rejected;
+            s.effective_sample_size = effective_sample_size;
+            s.evidence_parsing_seconds = (double) evidence_parsing_ns * 1e-9;
+            s.sampling_seconds = (double) sampling_ns * 1e-9;
+            s.reduction_seconds = (double) reduction_ns * 1e-9;
+            s.normalization_seconds = (double) normalization_ns * 1e-9;
+            s.worker_tasks = worker_tasks;
+            s.max_queue_depth = max_queue_depth;
+            return s;
+        }
+
+        void reset() {
+            samples_drawn = samples_rejected = 0;
+            effective_sample_size = 0;
+            evidence_parsing_ns = sampling_ns = reduction_ns = normalization_ns = 0;
+            worker_tasks = max_queue_depth = 0;
+        }
+    };
+
+    // adds the time elapsed between its construction and its destruction to a counter (in nanoseconds)
+    class StatsTimer {
+    public:
+        explicit StatsTimer(std::atomic<uint64_t>& counter) : counter(counter), start(std::chrono::steady_clock::now()) {}
+
+        ~StatsTimer() {
+            stop();
+        }
+
+        //adds the elapsed time to the counter, later calls have no effect
+        void stop() {
+            if (stopped)
+                return;
+            stopped = true;
+            counter += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        StatsTimer(const StatsTimer&) = delete;
+        StatsTimer& operator=(const StatsTimer&) = delete;
+
+    private:
+        std::atomic<uint64_t>& counter;
+        std::chrono::steady_clock::time_point start;
+        bool stopped = false;
+    };
+}
+
+#endif //BAYESIANNETWORKS_STATS_H
@@ -0,0 +1,452 @@
+#include "baynet/StructureLearner.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+#include "CsvReader.h"
+
+namespace {
+    // a change of one edge of the structure
+    struct Move {
+        enum Type { Add, Delete, Reverse } type;
+        int from;
+        int to;
+    };
+
+    // returns the parents with parent added, sorted
+    std::vector<int> with(std::vector<int> parents, int parent) {
+        parents.insert(std::upper_bound(parents.begin(), parents.end(), parent), parent);
+        return parents;
+    }
+
+    // returns the parents without parent
+    std::vector<int> without(std::vector<int> parents, int parent) {
+        parents.erase(std::find(parents.begin(), parents.end(), parent));
+        return parents;
+    }
+
+    // returns true if id follows the grammar of the xdsl ids: a letter or an underscore, then letters, digits or underscores
+    bool valid_id(std::string_view id) {
+        auto is_letter = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; };
+        if (id.empty() || !is_letter(id[0]))
+            return false;
+        return std::all_of(id.begin() + 1, id.end(), [&](char c) { return is_letter(c) || (c >= '0' && c <= '9'); });
+    }
+
+    std::string resolve_path(const std::string& path) {
+        return std::filesystem::path(path).is_absolute() ? path : "../../" + path;
+    }
+}
+
+baynet::StructureLearner::StructureLearner(const std::string& csv_path)
+    : pool(ThreadPool::shared())
+{
+    BAYNET_TRACE_SCOPE("StructureLearner::read");
+    csv::Reader reader(resolve_path(csv_path));
+    size_t n_nodes = reader.get_columns().size();
+    for (std::string_view column : reader.get_columns())
+        names.emplace_back(column);
+
+    // each worker gives its own ids to the values of its part of the file, then they are merged into the sorted states
+    std::vector<std::string_view> chunks = reader.split(pool->size());
+    std::vector<std::vector<std::vector<std::string_view>>> chunk_values(chunks.size(), std::vector<std::vector<std::string_view>>(n_nodes));
+    std::vector<std::vector<std::vector<uint32_t>>> chunk_ids(chunks.size(), std::vector<std::vector<uint32_t>>(n_nodes));
+    pool->parallel_for(chunks.size(), [&](size_t c) {
+        std::vector<std::unordered_map<std::string_view, uint32_t>> ids(n_nodes);
+        std::vector<std::string_view> fields;
+        std::string_view chunk = chunks[c];
+        while (reader.next(chunk, fields)) {
+            for (size_t f = 0; f < n_nodes; f++) {
+                if (fields[f].empty() || fields[f] == "?")
+                    throw std::runtime_error("Missing value at line " + std::to_string(reader.line_of(fields[f].data())));
+                auto [it, inserted] = ids[f].try_emplace(fields[f], (uint32_t) chunk_values[c][f].size());
+                if (inserted)
+                    chunk_values[c][f].push_back(fields[f]);
+                chunk_ids[c][f].push_back(it->second);
+            }
+        }
+    });
+
+    states.resize(n_nodes);
+    data.resize(n_nodes);
+    for (size_t c = 0; c < chunks.size(); c++)
+        n_cases += n_nodes > 0 ? chunk_ids[c][0].size() : 0;
+    if (n_cases == 0)
+        throw std::runtime_error("No cases in " + csv_path);
+    for (size_t i = 0; i < n_nodes; i++) {
+        std::vector<std::string_view> values;
+        for (size_t c = 0; c < chunks.size(); c++)
+            values.insert(values.end(), chunk_values[c][i].begin(), chunk_values[c][i].end());
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        if (values.size() > std::numeric_limits<uint16_t>::max())
+            throw std::runtime_error("Too many states in column " + names[i]);
+        states[i].assign(values.begin(), values.end());
+
+        data[i].reserve(n_cases);
+        for (size_t c = 0; c < chunks.size(); c++) {
+            std::vector<uint16_t> state_of(chunk_values[c][i].size());
+            for (size_t v = 0; v < state_of.size(); v++)
+                state_of[v] = (uint16_t) (std::lower_bound(values.begin(), values.end(), chunk_values[c][i][v]) - values.begin());
+            for (uint32_t id : chunk_ids[c][i])
+                data[i].push_back(state_of[id]);
+        }
+    }
+
+    n_words = (n_cases + 63) / 64;
+    bitmap_offsets.assign(n_nodes + 1, 0);
+    for (size_t i = 0; i < n_nodes; i++)
+        bitmap_offsets[i + 1] = bitmap_offsets[i] + states[i].size();
+    bitmaps.assign(bitmap_offsets.back() * n_words, 0);
+    pool->parallel_for(n_nodes, [&](size_t i) {
+        uint64_t* node_bitmaps = bitmaps.data() + bitmap_offsets[i] * n_words;
+        for (size_t c = 0; c < n_cases; c++)
+            node_bitmaps[data[i][c] * n_words + c / 64] |= (uint64_t) 1 << (c % 64);
+    });
+    parents.assign(n_nodes, {});
+}
+
+void baynet::StructureLearner::count_family(int node, const std::vector<int>& family_parents, std::vector<uint32_t>& counts) const {
+    size_t n_states = states[node].size();
+    size_t depth = family_parents.size();
+    // masks[d] has the cases of the configuration of the first d parents being visited, in the words [first[d], last[d])
+    std::vector<std::vector<uint64_t>> masks(depth + 1, std::vector<uint64_t>(n_words));
+    std::vector<size_t> first(depth + 1, 0), last(depth + 1, n_words);
+    std::fill(masks[0].begin(), masks[0].end(), ~(uint64_t) 0);
+    if (n_cases % 64 != 0)
+        masks[0].back() = ((uint64_t) 1 << (n_cases % 64)) - 1;
+
+    size_t n_rows = 1;
+    for (int parent : family_parents)
+        n_rows *= states[parent].size();
+    counts.assign(n_rows * n_states, 0);
+
+    auto visit = [&](auto& self, size_t d, size_t row) -> void {
+        const uint64_t* mask = masks[d].data();
+        if (d == depth) {
+            for (size_t s = 0; s < n_states; s++) {
+                const uint64_t* bitmap = bitmaps.data() + (bitmap_offsets[node] + s) * n_words;
+                uint32_t count = 0;
+                for (size_t w = first[d]; w < last[d]; w++)
+                    count += std::popcount(mask[w] & bitmap[w]);
+                counts[row * n_states + s] = count;
+            }
+            return;
+        }
+        int parent = family_parents[d];
+        for (size_t s = 0; s < states[parent].size(); s++) {
+            const uint64_t* bitmap = bitmaps.data() + (bitmap_offsets[parent] + s) * n_words;
+            uint64_t* next = masks[d + 1].data();
+            size_t lo = last[d], hi = first[d];
+            for (size_t w = first[d]; w < last[d]; w++) {
+                next[w] = mask[w] & bitmap[w];
+                if (next[w]) {
+                    lo = std::min(lo, w);
+                    hi = w + 1;
+                }
+            }
+            if (lo >= hi)
+                continue; // no case has this configuration: all its counts are 0
+            first[d + 1] = lo;
+            last[d + 1] = hi;
+            self(self, d + 1, row * states[parent].size() + s);
+        }
+    };
+    visit(visit, 0, 0);
+}
+
+double baynet::StructureLearner::family_score(int node, const std::vector<int>& family_parents, const StructureOptions& options) const {
+    std::vector<uint32_t> counts;
+    count_family(node, family_parents, counts);
+    size_t n_states = states[node].size();
+    size_t n_rows = counts.size() / n_states;
+
+    double score = 0;
+    if (options.score == StructureScore::BIC) {
+        for (size_t r = 0; r < n_rows; r++) {
+            const uint32_t* row = counts.data() + r * n_states;
+            double total = 0;
+            for (size_t s = 0; s < n_states; s++)
+                total += row[s];
+            for (size_t s = 0; s < n_states; s++)
+                if (row[s] > 0)
+                    score += row[s] * std::log(row[s] / total);
+        }
+        score -= 0.5 * std::log((double) n_cases) * (double) (n_rows * (n_states - 1));
+    } else {
+        double row_prior = options.equivalent_sample_size / (double) n_rows;
+        double entry_prior = row_prior / (double) n_states;
+        for (size_t r = 0; r < n_rows; r++) {
+            const uint32_t* row = counts.data() + r * n_states;
+            double total = 0;
+            for (size_t s = 0; s < n_states; s++) {
+                total += row[s];
+                if (row[s] > 0)
+                    score += std::lgamma(entry_prior + row[s]) - std::lgamma(entry_prior);
+            }
+            score += std::lgamma(row_prior) - std::lgamma(row_prior + total); // 0 for the rows without cases
+        }
+    }
+    return score;
+}
+
+std::string baynet::StructureLearner::family_key(int node, const std::vector<int>& family_parents) {
+    std::string key((const char*) &node, sizeof(int));
+    key.append((const char*) family_parents.data(), family_parents.size() * sizeof(int));
+    return key;
+}
+
+double baynet::StructureLearner::cached_score(int node, const std::vector<int>& family_parents) const {
+    return score_cache.at(family_key(node, family_parents));
+}
+
+baynet::StructureResult baynet::StructureLearner::learn(const StructureOptions& options) {
+    BAYNET_TRACE_SCOPE("StructureLearner::learn");
+    if (options.max_parents < 0 || options.max_iterations < 0 || options.tabu_size < 0 || options.max_no_improvement < 0 ||
+        (options.score == StructureScore::BDeu && options.equivalent_sample_size <= 0))
+        throw std::invalid_argument("Invalid structure options.");
+    if (options.score != cache_score || (options.score == StructureScore::BDeu && options.equivalent_sample_size != cache_sample_size)) {
+        score_cache.clear();
+        cache_score = options.score;
+        cache_sample_size = options.equivalent_sample_size;
+    }
+
+    int n_nodes = (int) names.size();
+    std::vector<std::vector<int>> best_parents(n_nodes);
+    parents = best_parents;
+
+    // scores the families that are not in the cache yet, in parallel
+    std::vector<std::pair<int, std::vector<int>>> pending;
+    std::unordered_set<std::string> pending_keys;
+    auto require = [&](int node, std::vector<int> family_parents) {
+        std::string key = family_key(node, family_parents);
+        if (!score_cache.count(key) && pending_keys.insert(std::move(key)).second)
+            pending.emplace_back(node, std::move(family_parents));
+    };
+    auto score_pending = [&] {
+        BAYNET_TRACE_SCOPE("score_families");
+        std::vector<double> scores(pending.size());
+        pool->parallel_for(pending.size(), [&](size_t k) { scores[k] = family_score(pending[k].first, pending[k].second, options); });
+        for (size_t k = 0; k < pending.size(); k++)
+            score_cache.emplace(family_key(pending[k].first, pending[k].second), scores[k]);
+        pending.clear();
+        pending_keys.clear();
+    };
+
+    for (int i = 0; i < n_nodes; i++)
+        require(i, {});
+    score_pending();
+    double score = 0;
+    for (int i = 0; i < n_nodes; i++)
+        score += cached_score(i, {});
+    double best_score = score;
+
+    std::deque<std::pair<int, int>> tabu; // edges (smaller node first) changed by the last moves
+    std::vector<char> reach(n_nodes * n_nodes); // reach[u * n + v]: there is a directed path from u to v
+    std::vector<std::vector<int>> children(n_nodes);
+    std::vector<Move> moves;
+    int since_best = 0;
+    StructureResult result;
+    for (int iteration = 0; iteration < options.max_iterations; iteration++) {
+        for (int v = 0; v < n_nodes; v++)
+            children[v].clear();
+        for (int v = 0; v < n_nodes; v++)
+            for (int u : parents[v])
+                children[u].push_back(v);
+        std::fill(reach.begin(), reach.end(), 0);
+        for (int u = 0; u < n_nodes; u++) {
+            std::vector<int> stack = children[u];
+            while (!stack.empty()) {
+                int w = stack.back();
+                stack.pop_back();
+                if (reach[u * n_nodes + w])
+                    continue;
+                reach[u * n_nodes + w] = 1;
+                stack.insert(stack.end(), children[w].begin(), children[w].end());
+            }
+        }
+
+        // the moves that keep the network acyclic and within max_parents
+        moves.clear();
+        for (int v = 0; v < n_nodes; v++) {
+            for (int u = 0; u < n_nodes; u++) {
+                if (u == v)
+                    continue;
+                if (std::binary_search(parents[v].begin(), parents[v].end(), u)) {
+                    moves.push_back({Move::Delete, u, v});
+                    require(v, without(parents[v], u));
+                    // reversing u -> v makes a cycle if there is another path from u to v
+                    bool other_path = std::any_of(children[u].begin(), children[u].end(), [&](int w) { return w != v && reach[w * n_nodes + v]; });
+                    if (!other_path && parents[u].size() < options.max_parents) {
+                        moves.push_back({Move::Reverse, u, v});
+                        require(u, with(parents[u], v));
+                    }
+                } else if (!reach[v * n_nodes + u] && parents[v].size() < options.max_parents) {
+                    moves.push_back({Move::Add, u, v});
+                    require(v, with(parents[v], u));
+                }
+            }
+        }
+        score_pending();
+
+        const Move* best_move = nullptr;
+        double best_delta = -std::numeric_limits<double>::infinity();
+        for (const Move& move : moves) {
+            double delta;
+            if (move.type == Move::Add)
+                delta = cached_score(move.to, with(parents[move.to], move.from)) - cached_score(move.to, parents[move.to]);
+            else
+                delta = cached_score(move.to, without(parents[move.to], move.from)) - cached_score(move.to, parents[move.to]);
+            if (move.type == Move::Reverse)
+                delta += cached_score(move.from, with(parents[move.from], move.to)) - cached_score(move.from, parents[move.from]);
+
+            std::pair<int, int> edge = std::minmax(move.from, move.to);
+            bool is_tabu = std::find(tabu.begin(), tabu.end(), edge) != tabu.end();
+            if (is_tabu && score + delta <= best_score + 1e-9)
+                continue; // a tabu move is allowed only if it gives a new best structure
+            if (delta > best_delta) {
+                best_delta = delta;
+                best_move = &move;
+            }
+        }
+        if (!best_move || (options.tabu_size == 0 && best_delta <= 1e-9))
+            break;
+
+        Move move = *best_move;
+        if (move.type == Move::Add) {
+            parents[move.to] = with(parents[move.to], move.from);
+        } else {
+            parents[move.to] = without(parents[move.to], move.from);
+            if (move.type == Move::Reverse)
+                parents[move.from] = with(parents[move.from], move.to);
+        }
+        score += best_delta;
+        result.iterations++;
+        if (options.tabu_size > 0) {
+            tabu.push_back(std::minmax(move.from, move.to));
+            if (tabu.size() > options.tabu_size)
+                tabu.pop_front();
+        }
+
+        if (score > best_score + 1e-9) {
+            best_score = score;
+            best_parents = parents;
+            since_best = 0;
+        } else if (++since_best >= options.max_no_improvement) {
+            break;
+        }
+    }
+
+    parents = std::move(best_parents);
+    result.score = best_score;
+    result.cached_families = score_cache.size();
+    return result;
+}
+
+const std::vector<std::vector<int>>& baynet::StructureLearner::get_parents() const {
+    return parents;
+}
+
+const std::vector<std::string>& baynet::StructureLearner::get_names() const {
+    return names;
+}
+
+size_t baynet::StructureLearner::get_n_cases() const {
+    return n_cases;
+}
+
+void baynet::StructureLearner::write_xdsl(const std::string& filename, const LearnOptions& options) const {
+    // the names and the values are written as they are, so they must be valid ids (checked before the file is created)
+    for (size_t v = 0; v < names.size(); v++) {
+        if (!valid_id(names[v]))
+            throw std::invalid_argument("Column \"" + names[v] + "\" is not a valid xdsl id");
+        for (const std::string& state : states[v])
+            if (!valid_id(state))
+                throw std::invalid_argument("Value \"" + state + "\" of column " + names[v] + " is not a valid xdsl id");
+    }
+
+    std::ofstream out(resolve_path(filename));
+    if (!out)
+        throw std::runtime_error("Can not open " + filename);
+
+    // the nodes are written in topological order, the parents of a node in the order of the columns
+    int n_nodes = (int) names.size();
+    std::vector<int> order;
+    std::vector<int> missing_parents(n_nodes);
+    for (int v = 0; v < n_nodes; v++)
+        missing_parents[v] = (int) parents[v].size();
+    std::vector<bool> written(n_nodes, false);
+    while (order.size() < n_nodes) {
+        for (int v = 0; v < n_nodes; v++) {
+            if (written[v] || missing_parents[v] > 0)
+                continue;
+            written[v] = true;
+            order.push_back(v);
+            for (int w = 0; w < n_nodes; w++)
+                if (std::binary_search(parents[w].begin(), parents[w].end(), v))
+                    missing_parents[w]--;
+            break;
+        }
+    }
+
+    out << "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n";
+    out << "<smile version=\"1.0\" id=\"Learned\" numsamples=\"1000\" discsamples=\"10000\">\n";
+    out << "\t<nodes>\n";
+    std::vector<uint32_t> counts;
+    for (int v : order) {
+        out << "\t\t<cpt id=\"" << names[v] << "\">\n";
+        for (const std::string& state : states[v])
+            out << "\t\t\t<state id=\"" << state << "\" />\n";
+        if (!parents[v].empty()) {
+            out << "\t\t\t<parents>";
+            for (size_t p = 0; p < parents[v].size(); p++)
+                out << (p == 0 ? "" : " ") << names[parents[v][p]];
+            out << "</parents>\n";
+        }
+
+        // relative frequencies smoothed with the prior, like Graph::learn_parameters
+        count_family(v, parents[v], counts);
+        size_t n_states = states[v].size();
+        size_t n_rows = counts.size() / n_states;
+        double alpha = 0;
+        if (options.prior == ParameterPrior::Dirichlet)
+            alpha = options.pseudo_count;
+        else if (options.prior == ParameterPrior::BDeu)
+            alpha = options.equivalent_sample_size / (double) (n_rows * n_states);
+        out << "\t\t\t<probabilities>";
+        for (size_t r = 0; r < n_rows; r++) {
+            double sum = 0;
+            for (size_t s = 0; s < n_states; s++)
+                sum += counts[r * n_states + s] + alpha;
+            for (size_t s = 0; s < n_states; s++) {
+                float probability = sum > 0 ? (float) ((counts[r * n_states + s] + alpha) / sum) : 1.0f / (float) n_states;
+                char buffer[32];
+                auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), probability);
+                out << (r == 0 && s == 0 ? "" : " ") << std::string_view(buffer, end - buffer);
+            }
+        }
+        out << "</probabilities>\n";
+        out << "\t\t</cpt>\n";
+    }
+    out << "\t</nodes>\n";
+    out << "</smile>\n";
+    if (!out)
+        throw std::runtime_error("Can not write " + filename);
+}
+
+std::unique_ptr<baynet::Graph> baynet::StructureLearner::make_graph(const std::string& filename, const LearnOptions& options,
+                                                                    const LoadOptions& load_options) const {
+    write_xdsl(filename, options);
+    return std::make_unique<Graph>(filename, load_options);
+}
+
+void baynet::StructureLearner::set_num_threads(int num_threads) {
+    pool = std::make_shared<ThreadPool>(num_threads);
+}
@@ -0,0 +1,35 @@
+#include "SymbolTable.h"
+#include <stdexcept>
+#include <vector>
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    if (frozen)
+        throw std::logic_error("The symbol table is frozen.");
+    auto it = ids.find(name);
+    if (it != ids.end())
+        return it->second;
+    symbols.emplace_back(name);
+    uint32_t id = (uint32_t) symbols.size() - 1;
+    ids.emplace(symbols.back(), id);
+    return id;
+}
+
+void SymbolTable::freeze() {
+    std::vector<std::string_view> keys(symbols.begin(), symbols.end());
+    lookup = PerfectHash(std::move(keys));
+    ids = {};
+    frozen = true;
+}
+
+uint32_t SymbolTable::find(std::string_view name) const {
+    if (!frozen) {
+        auto it = ids.find(name);
+        return it != ids.end() ? it->second : npos;
+    }
+    int id = lookup.find(name);
+    return id >= 0 ? (uint32_t) id : npos;
+}
+
+size_t SymbolTable::size() const {
+    return symbols.size();
+}
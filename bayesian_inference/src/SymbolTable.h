@@ -0,0 +1,45 @@
+#ifndef BAYESIANNETWORKS_SYMBOLTABLE_H
+#define BAYESIANNETWORKS_SYMBOLTABLE_H
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "PerfectHash.h"
+
+/*
+ * Names of the nodes and of the states of a graph, each one stored once and identified by a uint32_t id.
+ * While the graph is loaded names are interned through a hash map; freeze replaces it with a perfect hash,
+ * after that the table is read-only and can be used by several threads
+ */
+class SymbolTable {
+public:
+    static constexpr uint32_t npos = UINT32_MAX; // id returned for unknown names
+
+    //returns the id of the name, adding it if it is new. Must not be called after freeze
+    uint32_t intern(std::string_view name);
+
+    //builds the perfect hash used by find and releases the map used while interning
+    void freeze();
+
+    //returns the id of the name, npos if it is unknown
+    uint32_t find(std::string_view name) const;
+
+    //returns the name with the given id
+    inline std::string_view name(uint32_t id) const {
+        return symbols[id];
+    }
+
+    //returns the number of names
+    size_t size() const;
+
+private:
+    std::deque<std::string> symbols; // a deque never moves its elements, so the views of the names stay valid
+    std::unordered_map<std::string_view, uint32_t> ids; // only until freeze
+    PerfectHash lookup; // built by freeze
+    bool frozen = false;
+};
+
+#endif //BAYESIANNETWORKS_SYMBOLTABLE_H
@@ -0,0 +1,64 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+thread_local const ThreadPool* ThreadPool::current = nullptr;
+
+ThreadPool::ThreadPool(int num_workers) {
+    num_workers = std::max(1, num_workers);
+    workers.reserve(num_workers);
+    for (int i = 0; i < num_workers; i++)
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::shared() {
+    static std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>((int) std::thread::hardware_concurrency() - 1);
+    return pool;
+}
+
+int ThreadPool::size() const {
+    return (int) workers.size();
+}
+
+size_t ThreadPool::queue_depth() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tasks.size();
+}
+
+bool ThreadPool::run_queued() {
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty())
+            return false;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop() {
+    current = this;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) // stopping and nothing left to do
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef BAYESIANNETWORKS_THREADPOOL_H
+#define BAYESIANNETWORKS_THREADPOOL_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads executing the tasks submitted to a FIFO queue.
+ * The workers are started by the constructor and joined by the destructor, after the queue has been drained.
+ * A task that waits for other tasks of the same pool must do it with wait (or parallel_for), which runs the queued tasks
+ * meanwhile: otherwise all the workers may end up waiting
+ */
+class ThreadPool {
+public:
+    //starts num_workers threads (at least 1)
+    explicit ThreadPool(int num_workers);
+
+    ~ThreadPool();
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    //returns the pool shared by the whole process, with a worker for each hardware thread but one, started on first use
+    static std::shared_ptr<ThreadPool> shared();
+
+    //queues a task, returns the future of its result (exceptions thrown by the task are stored in the future)
+    template <typename F>
+    auto submit(F&& task) -> std::future<std::invoke_result_t<F>>;
+
+    /*
+     * Calls fn(i) for each i in [0, n) on all the workers and waits for the end (see wait).
+     * Indexes are handed out one at a time, so that items with very different costs are balanced.
+     * The first exception thrown by fn is rethrown
+     */
+    template <typename F>
+    void parallel_for(size_t n, F fn);
+
+    /*
+     * Waits until a future of a task of this pool is ready. On a worker of the pool, the queued tasks are run on the
+     * calling thread meanwhile: the task waited for is then either run by it or already running on another worker
+     */
+    template <typename R>
+    void wait(const std::future<R>& result);
+
+    //returns the number of workers
+    int size() const;
+
+    //returns the number of tasks waiting to be executed
+    size_t queue_depth();
+
+private:
+    void worker_loop();
+
+    //runs the first queued task on the calling thread, returns false if there was none
+    bool run_queued();
+
+    static thread_local const ThreadPool* current; // pool of the calling worker, null on the other threads
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex; // protects tasks and stopping
+    std::condition_variable cv;
+    bool stopping = false;
+};
+
+template <typename F>
+auto ThreadPool::submit(F&& task) -> std::future<std::invoke_result_t<F>> {
+    // std::function must be copyable, so the packaged_task is kept in a shared_ptr
+    auto packaged = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(task));
+    std::future<std::invoke_result_t<F>> result = packaged->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace_back([packaged] { (*packaged)(); });
+    }
+    cv.notify_one();
+    return result;
+}
+
+template <typename R>
+void ThreadPool::wait(const std::future<R>& result) {
+    if (current == this)
+        while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready && run_queued()) {}
+    result.wait();
+}
+
+template <typename F>
+void ThreadPool::parallel_for(size_t n, F fn) {
+    std::atomic<size_t> next = 0;
+    auto loop = [&] {
+        for (size_t i = next++; i < n; i = next++)
+            fn(i);
+    };
+
+    std::vector<std::future<void>> results;
+    int n_tasks = (int) std::min<size_t>(workers.size(), n);
+    for (int t = 0; t < n_tasks; t++)
+        results.push_back(submit(loop));
+
+    // wait for all the tasks before rethrowing, since they reference the local variables
+    for (auto& res : results)
+        wait(res);
+    for (auto& res : results)
+        res.get();
+}
+
+#endif //BAYESIANNETWORKS_THREADPOOL_H
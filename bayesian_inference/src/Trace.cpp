@@ -0,0 +1,79 @@
+#include "Trace.h"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    struct Event {
+        const char* name;
+        int tid;
+        double ts; // microseconds since the start of the session
+        double dur; // microseconds
+    };
+
+    std::atomic<bool> session_active = false;
+    std::mutex events_mutex; // protects the fields below
+    std::vector<Event> events;
+    std::string output;
+    std::chrono::steady_clock::time_point session_start;
+
+    // small sequential thread ids make the timeline easier to read than the native ones
+    int thread_id() {
+        static std::atomic<int> next_id = 1;
+        thread_local int id = next_id++;
+        return id;
+    }
+
+    double microseconds(std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+}
+
+void baynet::trace::start(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.clear();
+    output = filename;
+    session_start = std::chrono::steady_clock::now();
+    session_active = true;
+}
+
+void baynet::trace::stop() {
+    std::lock_guard<std::mutex> lock(events_mutex);
+    if (!session_active)
+        return;
+    session_active = false;
+
+    std::ofstream out(output);
+    if (!out)
+        throw std::runtime_error("Can not write the trace in " + output);
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event& e = events[i];
+        out << (i == 0 ? "\n" : ",\n") << "{\"name\":\"" << e.name << "\",\"cat\":\"baynet\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+            << e.tid << ",\"ts\":" << e.ts << ",\"dur\":" << e.dur << "}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    events.clear();
+}
+
+bool baynet::trace::active() {
+    return session_active;
+}
+
+baynet::trace::Span::Span(const char* name)
+    : name(name), recording(session_active), begin(std::chrono::steady_clock::now()) {}
+
+baynet::trace::Span::~Span() {
+    if (!recording)
+        return;
+    auto end = std::chrono::steady_clock::now();
+    int tid = thread_id();
+    std::lock_guard<std::mutex> lock(events_mutex);
+    if (session_active) // the session may have been stopped meanwhile
+        events.push_back({name, tid, microseconds(begin - session_start), microseconds(end - begin)});
+}
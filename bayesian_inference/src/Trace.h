@@ -0,0 +1,52 @@
+#ifndef BAYESIANNETWORKS_TRACE_H
+#define BAYESIANNETWORKS_TRACE_H
+#pragma once
+
+#include <chrono>
+#include <string>
+
+/*
+ * Timeline of the library in the Chrome trace-event format, which can be opened in Perfetto (ui.perfetto.dev)
+ * or chrome://tracing.
+ * Spans are recorded only when the library is built with BAYNET_ENABLE_TRACE (cmake -DBAYNET_ENABLE_TRACE=ON)
+ * and a session is active, otherwise every BAYNET_TRACE_SCOPE is removed by the preprocessor.
+ */
+
+#define BAYNET_TRACE_CONCAT_IMPL(a, b) a##b
+#define BAYNET_TRACE_CONCAT(a, b) BAYNET_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef BAYNET_ENABLE_TRACE
+#define BAYNET_TRACE_SCOPE(name) baynet::trace::Span BAYNET_TRACE_CONCAT(trace_span_, __LINE__)(name)
+#else
+#define BAYNET_TRACE_SCOPE(name)
+#endif
+
+namespace baynet::trace {
+    //starts recording the spans, they will be written in the given file when the session is stopped
+    void start(const std::string& filename);
+
+    //stops the session and writes the trace. Throws std::runtime_error if the file can not be written
+    void stop();
+
+    //returns true if a session is active
+    bool active();
+
+    // records the time elapsed between its construction and its destruction as a complete event
+    class Span {
+    public:
+        // name must be a string literal
+        explicit Span(const char* name);
+
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* name;
+        bool recording;
+        std::chrono::steady_clock::time_point begin;
+    };
+}
+
+#endif //BAYESIANNETWORKS_TRACE_H
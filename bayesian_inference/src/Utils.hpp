@@ -15,8 +15,9 @@ namespace utils {
     size_t calc_cpt_size(const std::vector<std::vector<T>>& cpt);
 
     // normalizes the occurrencies of the input states and returns the conditional probabilites
+    // (rounded to two decimals if round_results is true)
     template <typename T>
-    std::vector<T> normalize(const std::vector<T>& posteriors);
+    std::vector<T> normalize(const std::vector<T>& posteriors, bool round_results = true);
 
     //given a string as input it counts the number of words (space separated strings)
     int word_count(const std::string &input);
@@ -35,15 +36,15 @@ size_t utils::calc_cpt_size(const std::vector<std::vector<T>>& cpt) {
 }
 
 template <typename T>
-std::vector<T> utils::normalize(const std::vector<T>& posteriors) {
+std::vector<T> utils::normalize(const std::vector<T>& posteriors, bool round_results) {
     std::vector<T> normalized_post(posteriors.size());
-    float sum = 0;
+    double sum = 0; // in double whatever T is, so that the float posteriors are normalised like the double ones
     for (T posterior: posteriors)
         sum += posterior;
     for (int i = 0; i < posteriors.size(); i++) {
-        T posterior = posteriors[i];
-        posterior /= sum;
-        posterior = round(posterior * 100.0) / 100.0;
+        T posterior = (T) (posteriors[i] / sum);
+        if (round_results)
+            posterior = round(posterior * 100.0) / 100.0;
         normalized_post[i] = posterior;
     }
     return normalized_post;
@@ -0,0 +1,267 @@
+#include "XdslReader.h"
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+    bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    std::string_view trim(std::string_view text) {
+        while (!text.empty() && is_space(text.front()))
+            text.remove_prefix(1);
+        while (!text.empty() && is_space(text.back()))
+            text.remove_suffix(1);
+        return text;
+    }
+
+    // calls fn on every whitespace separated token of the text
+    template <typename F>
+    void for_each_token(std::string_view text, F fn) {
+        size_t i = 0;
+        while (i < text.size()) {
+            while (i < text.size() && is_space(text[i]))
+                i++;
+            size_t start = i;
+            while (i < text.size() && !is_space(text[i]))
+                i++;
+            if (i > start)
+                fn(text.substr(start, i - start));
+        }
+    }
+}
+
+xdsl::Reader::Reader(std::string_view buffer) : buffer(buffer) {
+    // move to the start of the <nodes> section
+    Tag tag;
+    while (read_tag(tag)) {
+        if (tag.name == "nodes" && !tag.closing) {
+            done = tag.self_closing;
+            return;
+        }
+    }
+    throw std::runtime_error("Missing <nodes> section.");
+}
+
+const std::vector<std::string_view>& xdsl::Reader::skipped_nodes() const {
+    return skipped;
+}
+
+bool xdsl::Reader::next(NodeDesc& node) {
+    Tag tag;
+    while (!done) {
+        if (!read_tag(tag))
+            throw std::runtime_error("Unexpected end of file in the <nodes> section.");
+
+        if (tag.closing) {
+            if (tag.name == "nodes")
+                done = true;
+            continue;
+        }
+        if (tag.self_closing)
+            continue;
+        if (tag.name != "cpt" && tag.name != "deterministic" && tag.name != "noisymax") {
+            std::string_view id = attribute(tag.attributes, "id");
+            if (!id.empty())
+                skipped.push_back(id);
+            skip_element(tag);
+            continue;
+        }
+
+        node.type = tag.name;
+        node.id = attribute(tag.attributes, "id");
+        node.states.clear();
+        node.parents.clear();
+        node.body = {};
+        node.strengths = {};
+        if (node.id.empty())
+            throw std::runtime_error("Node without id.");
+
+        Tag child;
+        while (true) {
+            if (!read_tag(child))
+                throw std::runtime_error("Unexpected end of file in node " + std::string(node.id) + ".");
+            if (child.closing) {
+                if (child.name != tag.name)
+                    throw std::runtime_error("Unexpected </" + std::string(child.name) + "> in node " + std::string(node.id) + ".");
+                break;
+            }
+
+            if (child.name == "state") {
+                node.states.push_back(attribute(child.attributes, "id"));
+                if (!child.self_closing)
+                    skip_element(child);
+            } else if (child.self_closing) {
+                continue;
+            } else if (child.name == "parents") {
+                node.parents = split(read_text(child));
+            } else if (child.name == "probabilities" || child.name == "resultingstates" || child.name == "parameters") {
+                node.body = read_text(child);
+            } else if (child.name == "strengths") {
+                node.strengths = read_text(child);
+            } else {
+                skip_element(child);
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool xdsl::Reader::read_tag(Tag& tag) {
+    while (true) {
+        pos = buffer.find('<', pos);
+        if (pos == std::string_view::npos) {
+            pos = buffer.size();
+            return false;
+        }
+
+        // comments, declarations and processing instructions
+        std::string_view rest = buffer.substr(pos);
+        std::string_view terminator;
+        if (rest.starts_with("<!--"))
+            terminator = "-->";
+        else if (rest.starts_with("<?"))
+            terminator = "?>";
+        else if (rest.starts_with("<!"))
+            terminator = ">";
+        if (!terminator.empty()) {
+            size_t end = buffer.find(terminator, pos);
+            if (end == std::string_view::npos)
+                throw std::runtime_error("Unterminated declaration.");
+            pos = end + terminator.size();
+            continue;
+        }
+
+        size_t end = buffer.find('>', pos);
+        if (end == std::string_view::npos)
+            throw std::runtime_error("Unterminated tag.");
+        std::string_view content = buffer.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+
+        tag.closing = !content.empty() && content.front() == '/';
+        if (tag.closing)
+            content.remove_prefix(1);
+        tag.self_closing = !content.empty() && content.back() == '/';
+        if (tag.self_closing)
+            content.remove_suffix(1);
+
+        size_t name_end = 0;
+        while (name_end < content.size() && !is_space(content[name_end]))
+            name_end++;
+        tag.name = content.substr(0, name_end);
+        tag.attributes = content.substr(name_end);
+        return true;
+    }
+}
+
+std::string_view xdsl::Reader::read_text(const Tag& start) {
+    size_t end = buffer.find('<', pos);
+    if (end == std::string_view::npos)
+        throw std::runtime_error("Unexpected end of file in <" + std::string(start.name) + ">.");
+    std::string_view text = buffer.substr(pos, end - pos);
+    pos = end;
+
+    Tag tag;
+    if (!read_tag(tag) || !tag.closing || tag.name != start.name)
+        throw std::runtime_error("Unexpected tag in <" + std::string(start.name) + ">.");
+    return trim(text);
+}
+
+void xdsl::Reader::skip_element(const Tag& start) {
+    int depth = 1;
+    Tag tag;
+    while (depth > 0) {
+        if (!read_tag(tag))
+            throw std::runtime_error("Unexpected end of file in <" + std::string(start.name) + ">.");
+        if (tag.closing)
+            depth--;
+        else if (!tag.self_closing)
+            depth++;
+    }
+}
+
+std::string_view xdsl::Reader::attribute(std::string_view attributes, std::string_view name) {
+    size_t i = 0;
+    while (i < attributes.size()) {
+        while (i < attributes.size() && is_space(attributes[i]))
+            i++;
+        size_t name_start = i;
+        while (i < attributes.size() && attributes[i] != '=' && !is_space(attributes[i]))
+            i++;
+        std::string_view attr_name = attributes.substr(name_start, i - name_start);
+
+        while (i < attributes.size() && (is_space(attributes[i]) || attributes[i] == '='))
+            i++;
+        if (i >= attributes.size())
+            break;
+        char quote = attributes[i];
+        size_t value_end = attributes.find(quote, i + 1);
+        if ((quote != '"' && quote != '\'') || value_end == std::string_view::npos)
+            throw std::runtime_error("Malformed attribute " + std::string(attr_name) + ".");
+
+        if (attr_name == name)
+            return attributes.substr(i + 1, value_end - i - 1);
+        i = value_end + 1;
+    }
+    return {};
+}
+
+std::vector<std::string_view> xdsl::split(std::string_view text) {
+    std::vector<std::string_view> tokens;
+    for_each_token(text, [&](std::string_view token) {
+        tokens.push_back(token);
+    });
+    return tokens;
+}
+
+std::vector<std::vector<float>> xdsl::parse_probabilities(std::string_view text, size_t row_length, size_t n_rows) {
+    std::vector<std::vector<float>> probabilities(n_rows);
+    for (auto& row : probabilities)
+        row.reserve(row_length);
+
+    size_t n = 0;
+    for_each_token(text, [&](std::string_view token) {
+        if (n >= row_length * n_rows) {
+            n++;
+            return;
+        }
+        float value;
+        auto [end, err] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (err != std::errc() || end != token.data() + token.size())
+            throw std::runtime_error("Invalid probability " + std::string(token) + ".");
+        probabilities[n / row_length].push_back(value);
+        n++;
+    });
+
+    if (n != row_length * n_rows)
+        throw std::runtime_error("Expected " + std::to_string(row_length * n_rows) + " probabilities, found " + std::to_string(n) + ".");
+    return probabilities;
+}
+
+std::vector<int> xdsl::parse_resulting_states(std::string_view text, const std::function<int(std::string_view)>& state_index, size_t n_rows) {
+    std::vector<int> indexes;
+    indexes.reserve(n_rows);
+    for_each_token(text, [&](std::string_view token) {
+        int index = state_index(token);
+        if (index < 0)
+            throw std::runtime_error("Unknown resulting state " + std::string(token) + ".");
+        indexes.push_back(index);
+    });
+
+    if (indexes.size() != n_rows)
+        throw std::runtime_error("Expected " + std::to_string(n_rows) + " resulting states, found " + std::to_string(indexes.size()) + ".");
+    return indexes;
+}
+
+std::vector<int> xdsl::parse_integers(std::string_view text) {
+    std::vector<int> values;
+    for_each_token(text, [&](std::string_view token) {
+        int value;
+        auto [end, err] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (err != std::errc() || end != token.data() + token.size())
+            throw std::runtime_error("Invalid integer " + std::string(token) + ".");
+        values.push_back(value);
+    });
+    return values;
+}
@@ -0,0 +1,88 @@
+#ifndef BAYESIANNETWORKS_XDSLREADER_H
+#define BAYESIANNETWORKS_XDSLREADER_H
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//namespace for the streaming reader of .xdsl files
+namespace xdsl {
+    /*
+     * Node of the <nodes> section of an .xdsl file.
+     * All the views point into the buffer read by the Reader, nothing is copied
+     */
+    struct NodeDesc {
+        std::string_view type; // tag of the node: "cpt", "deterministic" or "noisymax"
+        std::string_view id;
+        std::vector<std::string_view> states;
+        std::vector<std::string_view> parents;
+        std::string_view body; // text of <probabilities> (cpt), <resultingstates> (deterministic) or <parameters> (noisymax)
+        std::string_view strengths; // text of <strengths> (noisymax)
+    };
+
+    /*
+     * Pull parser of the <nodes> section of an .xdsl file.
+     * It tokenises the buffer in a single pass without building a DOM: nodes are returned one by one
+     * and the other tags (extensions, properties, unsupported node types) are skipped.
+     * Ids are taken verbatim, since GeNIe only allows letters, digits and underscores in them.
+     * Malformed input throws std::runtime_error.
+     */
+    class Reader {
+    public:
+        explicit Reader(std::string_view buffer);
+
+        //reads the next cpt, deterministic or noisymax node, returns false at the end of the <nodes> section
+        bool next(NodeDesc& node);
+
+        //returns the ids of the nodes of an unsupported type (e.g. equation nodes) skipped so far
+        const std::vector<std::string_view>& skipped_nodes() const;
+
+    private:
+        struct Tag {
+            std::string_view name;
+            std::string_view attributes;
+            bool closing = false; // </name>
+            bool self_closing = false; // <name ... />
+        };
+
+        //reads the next tag, skipping text, comments and declarations. Returns false at the end of the buffer
+        bool read_tag(Tag& tag);
+
+        //reads the text of an element whose start tag has just been read, up to its end tag
+        std::string_view read_text(const Tag& start);
+
+        //skips the content of an element whose start tag has just been read, up to its end tag
+        void skip_element(const Tag& start);
+
+        //returns the value of an attribute, an empty view if the tag does not have it
+        static std::string_view attribute(std::string_view attributes, std::string_view name);
+
+        std::string_view buffer;
+        size_t pos = 0;
+        bool done = false;
+        std::vector<std::string_view> skipped; // ids of the skipped nodes
+    };
+
+    //splits the text on whitespaces
+    std::vector<std::string_view> split(std::string_view text);
+
+    /*
+     * Parses the probabilities of a cpt straight into n_rows rows of row_length values.
+     * Throws std::runtime_error if a value is not a number or if the number of values is not n_rows * row_length
+     */
+    std::vector<std::vector<float>> parse_probabilities(std::string_view text, size_t row_length, size_t n_rows);
+
+    /*
+     * Parses the resulting states of a deterministic node, returning the index of the state of each row.
+     * state_index returns the index of a state name of the node, -1 if the node has no such state.
+     * Throws std::runtime_error if a state is unknown or if the number of states is not n_rows
+     */
+    std::vector<int> parse_resulting_states(std::string_view text, const std::function<int(std::string_view)>& state_index, size_t n_rows);
+
+    //parses a list of integers. Throws std::runtime_error if a value is not an integer
+    std::vector<int> parse_integers(std::string_view text);
+}
+
+#endif //BAYESIANNETWORKS_XDSLREADER_H
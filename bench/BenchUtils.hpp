@@ -0,0 +1,45 @@
+#ifndef BAYESIANNETWORKS_BENCHUTILS_HPP
+#define BAYESIANNETWORKS_BENCHUTILS_HPP
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "baynet/Graph.h"
+
+//namespace for the helpers shared by the benchmark executables
+namespace bench {
+    // returns the networks contained in the data folder, as paths accepted by the Graph constructor.
+    // Networks that can not be loaded (e.g. with unsupported node types) are skipped
+    inline std::vector<std::string> network_files() {
+        std::vector<std::string> files;
+        for (auto& entry : std::filesystem::directory_iterator("../../data")) {
+            if (entry.path().extension() != ".xdsl")
+                continue;
+            std::string file = "data/" + entry.path().filename().string();
+            try {
+                baynet::Graph network(file);
+                files.push_back(file);
+            } catch (const std::exception& e) {
+                std::cerr << "Skipping " << file << ": " << e.what() << "\n";
+            }
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    // evidence on the first state of the last node in topological order
+    inline std::string leaf_evidence(const baynet::Graph& network) {
+        const Node& leaf = network.node_list.back();
+        return std::string(leaf.get_name()) + "=" + std::string(leaf.get_state(0));
+    }
+
+    // evidence on the last state of the first node in topological order
+    inline std::string root_evidence(const baynet::Graph& network) {
+        const Node& root = network.node_list.front();
+        return std::string(root.get_name()) + "=" + std::string(root.get_state((int) root.get_n_states() - 1));
+    }
+}
+
+#endif //BAYESIANNETWORKS_BENCHUTILS_HPP
@@ -0,0 +1,150 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "baynet/Graph.h"
+#include "BenchUtils.hpp"
+
+/*
+ * Accuracy versus cost of the sampling algorithms.
+ * For every network in the data folder and every evidence scenario the exact posteriors of all the nodes are computed
+ * with variable elimination, then each sampling algorithm is run with several sample budgets and thread counts.
+ * Besides the wall time, each run reports the mean KL divergence (exact || estimate) over the nodes and the
+ * maximum absolute error over all the states (NaN when rejection sampling does not accept any sample).
+ * Every run is repeated with the float and the 16-bit fixed-point cpt storage; BM_QuantizationError isolates the error
+ * of the fixed-point storage by comparing variable elimination on the two storages.
+ */
+
+namespace {
+    const std::vector<int> sample_counts = {100, 1000, 10000};
+    const std::vector<int> thread_counts = {1, 4};
+    const std::vector<baynet::CptStorage> storages = {baynet::CptStorage::Float, baynet::CptStorage::Fixed16};
+    const int exact_algorithm = 2;
+
+    struct Scenario {
+        std::string name;
+        std::string (*evidence)(const baynet::Graph&);
+        bool has_evidence;
+    };
+
+    struct Algorithm {
+        std::string name;
+        int id;
+        bool needs_evidence; // forward sampling is only used when there is no evidence
+    };
+
+    const std::vector<Scenario> scenarios = {
+            {"prior", [](const baynet::Graph&) { return std::string(); }, false},
+            {"leaf", bench::leaf_evidence, true},
+            {"root_leaf", [](const baynet::Graph& g) { return bench::root_evidence(g) + "," + bench::leaf_evidence(g); }, true},
+    };
+
+    const std::vector<Algorithm> algorithms = {
+            {"forward_sampling", 0, false},
+            {"likelihood_weighting", 0, true},
+            {"rejection_sampling", 1, true},
+    };
+
+    // returns the mean KL divergence (exact || estimate) over the nodes and updates the maximum absolute error
+    double compare(const std::unordered_map<std::string, std::vector<float>>& exact,
+                   std::unordered_map<std::string, std::vector<float>>& estimate, double& max_error) {
+        double kl = 0;
+        for (auto& [query, p] : exact) {
+            const std::vector<float>& q = estimate[query];
+            for (int i = 0; i < p.size(); i++) {
+                // the estimate is smoothed, so that states never sampled give a finite divergence
+                double qi = i < q.size() ? std::max((double) q[i], 1e-6) : 1e-6;
+                if (p[i] > 0)
+                    kl += p[i] * std::log(p[i] / qi);
+                max_error = std::max(max_error, std::abs((double) p[i] - (i < q.size() ? q[i] : 0)));
+            }
+        }
+        return kl / (double) exact.size();
+    }
+
+    // state.range(0): number of samples, state.range(1): number of threads, state.range(2): cpt storage
+    void BM_Accuracy(benchmark::State& state, const std::string& file, const Scenario& scenario, const Algorithm& algorithm) {
+        std::string evidence;
+        std::unordered_map<std::string, std::vector<float>> exact;
+        {
+            // the reference is always computed on the float cpts
+            baynet::Graph reference(file);
+            reference.set_rounding(false);
+            evidence = scenario.evidence(reference);
+            exact = reference.inference(0, evidence, exact_algorithm);
+        }
+
+        baynet::LoadOptions options;
+        options.cpt_storage = storages[state.range(2)];
+        baynet::Graph network(file, options);
+        network.set_rounding(false);
+        network.set_num_threads((int) state.range(1));
+
+        double kl = 0, max_error = 0;
+        for (auto _ : state) {
+            auto estimate = network.inference((int) state.range(0), evidence, algorithm.id);
+
+            state.PauseTiming();
+            kl += compare(exact, estimate, max_error);
+            state.ResumeTiming();
+        }
+
+        state.counters["kl_divergence"] = kl / (double) state.iterations();
+        state.counters["max_abs_error"] = max_error;
+    }
+
+    // error of the 16-bit fixed-point storage alone: exact inference on the quantised cpts against the float ones
+    void BM_QuantizationError(benchmark::State& state, const std::string& file, const Scenario& scenario) {
+        baynet::Graph reference(file);
+        reference.set_rounding(false);
+        std::string evidence = scenario.evidence(reference);
+        auto exact = reference.inference(0, evidence, exact_algorithm);
+
+        baynet::LoadOptions options;
+        options.cpt_storage = baynet::CptStorage::Fixed16;
+        baynet::Graph network(file, options);
+        network.set_rounding(false);
+
+        double kl = 0, max_error = 0;
+        for (auto _ : state) {
+            auto quantized = network.inference(0, evidence, exact_algorithm);
+
+            state.PauseTiming();
+            kl += compare(exact, quantized, max_error);
+            state.ResumeTiming();
+        }
+
+        state.counters["kl_divergence"] = kl / (double) state.iterations();
+        state.counters["max_abs_error"] = max_error;
+    }
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    for (const std::string& file : bench::network_files()) {
+        std::string network = std::filesystem::path(file).stem().string();
+        for (const Scenario& scenario : scenarios) {
+            std::string quantization = "BM_QuantizationError/" + network + "/" + scenario.name;
+            benchmark::RegisterBenchmark(quantization.c_str(), BM_QuantizationError, file, scenario)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+            for (const Algorithm& algorithm : algorithms) {
+                if (algorithm.needs_evidence != scenario.has_evidence)
+                    continue;
+
+                std::string name = "BM_Accuracy/" + network + "/" + scenario.name + "/" + algorithm.name;
+                auto* b = benchmark::RegisterBenchmark(name.c_str(), BM_Accuracy, file, scenario, algorithm);
+                b->ArgNames({"samples", "threads", "storage"})->Unit(benchmark::kMillisecond)->UseRealTime()->Iterations(3);
+                for (int samples : sample_counts)
+                    for (int threads : thread_counts)
+                        for (int storage = 0; storage < storages.size(); storage++)
+                            b->Args({samples, threads, storage});
+            }
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include "baynet/Graph.h"
+#include "BenchUtils.hpp"
+#include "NetworkGenerator.h"
+
+/*
+ * Benchmark suite of the library.
+ * Every network in the data folder is loaded, sampled and queried, the multi-threaded algorithms are
+ * measured with several worker counts.
+ * Synthetic networks from 100 to 100k nodes are generated on first use in the temporary directory, to measure
+ * how load time, memory and sampling throughput scale.
+ * Run the bench_json target to store the results as JSON.
+ */
+
+namespace {
+    std::atomic<size_t> allocations = 0; // calls to operator new made by the whole process
+
+    const int num_samples = 10000;
+    const std::vector<int> thread_counts = {1, 2, 4, 8};
+    const std::vector<int> synthetic_sizes = {100, 1000, 10000, 100000};
+
+    // returns the path of the synthetic network with the given number of nodes, generating it if needed
+    std::string synthetic_network(int num_nodes) {
+        generator::NetworkOptions options;
+        options.num_nodes = num_nodes;
+        options.deterministic_share = 0.2f;
+        auto path = std::filesystem::temp_directory_path() / ("baynet_synthetic_" + std::to_string(num_nodes) + ".xdsl");
+        if (!std::filesystem::exists(path))
+            generator::write_network(options, path.string());
+        return path.string();
+    }
+
+    // returns the bytes allocated on the heap. Unlike the resident memory it goes down when a graph is destroyed,
+    // so that consecutive loads can be compared
+    size_t heap_memory() {
+        return mallinfo2().uordblks;
+    }
+
+    void BM_Load(benchmark::State& state, const std::string& file) {
+        for (auto _ : state) {
+            baynet::Graph network(file);
+            benchmark::DoNotOptimize(network.node_list.data());
+        }
+    }
+
+    // returns the load options with the cpt storage selected by a benchmark argument (0: float, 1: 16-bit fixed point)
+    baynet::LoadOptions storage_options(int64_t storage) {
+        baynet::LoadOptions options;
+        options.cpt_storage = storage == 0 ? baynet::CptStorage::Float : baynet::CptStorage::Fixed16;
+        return options;
+    }
+
+    // state.range(0): number of nodes of the synthetic network, state.range(1): cpt storage
+    void BM_LoadSynthetic(benchmark::State& state) {
+        std::string file = synthetic_network((int) state.range(0));
+        baynet::LoadOptions options = storage_options(state.range(1));
+        size_t memory = heap_memory();
+        {
+            baynet::Graph network(file, options);
+            memory = heap_memory() - memory;
+        }
+        for (auto _ : state) {
+            baynet::Graph network(file, options);
+            benchmark::DoNotOptimize(network.node_list.data());
+        }
+        state.counters["memory_MB"] = (double) memory / (1024.0 * 1024.0);
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    // state.range(0): number of nodes of the synthetic network, state.range(1): cpt storage
+    void BM_PriorSampleSynthetic(benchmark::State& state) {
+        baynet::Graph network(synthetic_network((int) state.range(0)), storage_options(state.range(1)));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(network.prior_sample());
+        }
+        state.counters["samples_per_second"] = benchmark::Counter((double) state.iterations(), benchmark::Counter::kIsRate);
+    }
+
+    void BM_PriorSample(benchmark::State& state, const std::string& file) {
+        baynet::Graph network(file);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(network.prior_sample());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void BM_WeightedSample(benchmark::State& state, const std::string& file) {
+        baynet::Graph network(file);
+        const Node& leaf = network.node_list.back();
+        std::unordered_map<std::string, std::string> evidence = {{std::string(leaf.get_name()), std::string(leaf.get_state(0))}};
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(network.weighted_sample(evidence));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // state.range(0): number of threads, state.range(1): algorithm (-1 means no evidence)
+    void BM_Inference(benchmark::State& state, const std::string& file) {
+        baynet::Graph network(file);
+        network.set_num_threads((int) state.range(0));
+        int algorithm = (int) state.range(1);
+        std::string evidence = algorithm < 0 ? "" : bench::leaf_evidence(network);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(network.inference(num_samples, evidence, std::max(algorithm, 0)));
+        }
+        state.SetItemsProcessed(state.iterations() * num_samples * (int64_t) network.node_list.size());
+    }
+
+    // state.range(0): 0 for the string API, 1 for the typed one (resolved once). A small query, where parsing matters
+    void BM_Query(benchmark::State& state, const std::string& file) {
+        baynet::Graph network(file);
+        network.set_num_threads(1);
+        const int query_samples = 100;
+        std::string leaf(network.node_list.back().get_name());
+        std::string evidence = bench::root_evidence(network);
+        std::string query = leaf + "|" + evidence;
+        baynet::NodeId query_node = network.resolve_node(leaf);
+        std::vector<baynet::EvidenceItem> evidence_items = network.resolve_evidence(evidence);
+        for (auto _ : state) {
+            if (state.range(0) == 0)
+                benchmark::DoNotOptimize(network.single_node_inference(query, query_samples, 0));
+            else
+                benchmark::DoNotOptimize(network.single_node_inference(query_node, evidence_items, query_samples, 0));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // state.range(0): algorithm. Counts the heap allocations made for each sample by a query of the leaf given the root
+    void BM_SamplerAllocations(benchmark::State& state, const std::string& file) {
+        baynet::Graph network(file);
+        network.set_num_threads(1);
+        int algorithm = (int) state.range(0);
+        std::string query = std::string(network.node_list.back().get_name()) + "|" + bench::root_evidence(network);
+        size_t before = allocations.load();
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(network.single_node_inference(query, num_samples, algorithm));
+        }
+        state.counters["allocations_per_sample"] = (double) (allocations.load() - before) / (double) (state.iterations() * num_samples);
+    }
+
+    void BM_EditCpt(benchmark::State& state, const std::string& file) {
+        baynet::Graph network(file);
+        const Node& root = network.node_list.front();
+        size_t n_states = root.get_n_states();
+
+        // alternate between two different distributions so that every call really replaces the cpt
+        std::string uniform, skewed;
+        for (size_t i = 0; i < n_states; i++) {
+            uniform += std::to_string(1.0f / (float) n_states) + " ";
+            skewed += (i == 0 ? "1" : "0") + std::string(" ");
+        }
+        uniform.pop_back();
+        skewed.pop_back();
+
+        bool flip = false;
+        for (auto _ : state) {
+            network.edit_cpt(std::string(root.get_name()), flip ? uniform : skewed);
+            flip = !flip;
+        }
+    }
+}
+
+// counts the allocations for BM_SamplerAllocations (the other forms of new and delete end up in these ones)
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    for (const std::string& file : bench::network_files()) {
+        std::string name = std::filesystem::path(file).stem().string();
+
+        benchmark::RegisterBenchmark(("BM_Load/" + name).c_str(), BM_Load, file);
+        benchmark::RegisterBenchmark(("BM_PriorSample/" + name).c_str(), BM_PriorSample, file);
+        benchmark::RegisterBenchmark(("BM_WeightedSample/" + name).c_str(), BM_WeightedSample, file);
+        benchmark::RegisterBenchmark(("BM_EditCpt/" + name).c_str(), BM_EditCpt, file);
+        benchmark::RegisterBenchmark(("BM_Query/" + name).c_str(), BM_Query, file)->ArgName("typed")->Arg(0)->Arg(1)->UseRealTime();
+        benchmark::RegisterBenchmark(("BM_SamplerAllocations/" + name).c_str(), BM_SamplerAllocations, file)
+                ->ArgName("algorithm")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+        auto* inference = benchmark::RegisterBenchmark(("BM_Inference/" + name).c_str(), BM_Inference, file);
+        inference->ArgNames({"threads", "algorithm"})->Unit(benchmark::kMillisecond)->UseRealTime();
+        for (int threads : thread_counts)
+            for (int algorithm : {-1, 0, 1})
+                inference->Args({threads, algorithm});
+    }
+
+    for (int size : synthetic_sizes) {
+        for (int storage : {0, 1}) {
+            benchmark::RegisterBenchmark("BM_LoadSynthetic", BM_LoadSynthetic)->ArgNames({"nodes", "storage"})->Args({size, storage})->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark("BM_PriorSampleSynthetic", BM_PriorSampleSynthetic)->ArgNames({"nodes", "storage"})->Args({size, storage})->Unit(benchmark::kMillisecond);
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
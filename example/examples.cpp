@@ -43,7 +43,7 @@ void example2() {
     std::cout<< "BEFORE MODIFICATION:"<<std::endl;
     //std::cout<<"Map dimension: "<<network.get_map_size()<<std::endl;
     network.print_node("Income");
-    auto backup1 = network.node_list[network.node_indexes["Income"]].get_hashed_cpt();
+    auto backup1 = network.node_list[network.get_node_index("Income")].get_hashed_cpt();
 
     system("pause");
     std::cout<<"\n\nNow let's try to edit a cpt."<<std::endl;
@@ -51,8 +51,8 @@ void example2() {
 
     network.edit_cpt("Income", "0.5 0.42 0.08");
     std::cout << "Modified Income: 0.5, 0.42, 0.08"<<std::endl;
-    std::cout <<"\nOld cpt count: "<<Node::probs_hashmap[backup1].use_count();
-    backup1 = network.node_list[network.node_indexes["Income"]].get_hashed_cpt();
+    std::cout <<"\nOld cpt count: "<<network.get_cpt_count(backup1);
+    backup1 = network.node_list[network.get_node_index("Income")].get_hashed_cpt();
 
 
     std::cout<< "\nAFTER MODIFICATION:"<<std::endl;
@@ -66,7 +66,7 @@ void example2() {
     std::cout<<"\n\nnow let's try to edit a cpt again:"<<std::endl;
     network.edit_cpt("Income", "0.333333 0.333333 0.333333");
     std::cout << "Modified Income: 0.333333, 0.333333, 0.333333"<<std::endl;
-    std::cout <<"\nOld cpt count: "<<Node::probs_hashmap[backup1].use_count();
+    std::cout <<"\nOld cpt count: "<<network.get_cpt_count(backup1);
 
     std::cout<< "\nAFTER SECOND MODIFICATION:"<<std::endl;
 
@@ -0,0 +1,108 @@
+#include "NetworkGenerator.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // probabilities are written as multiples of 1/resolution, so that each row sums exactly to 1
+    const int resolution = 10000;
+
+    std::string node_name(int i) {
+        return "N" + std::to_string(i);
+    }
+
+    std::string state_name(int i) {
+        return "s" + std::to_string(i);
+    }
+
+    // writes a random distribution over num_states states
+    void write_distribution(int num_states, std::mt19937& gen, std::ostream& out) {
+        std::uniform_real_distribution<double> dis(0, 1);
+        std::vector<double> weights(num_states);
+        for (double& w : weights)
+            w = dis(gen);
+        double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+        int left = resolution;
+        for (int i = 0; i < num_states; i++) {
+            int units = i == num_states - 1 ? left : std::min(left, (int) (weights[i] / sum * resolution));
+            left -= units;
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "%d.%04d", units / resolution, units % resolution);
+            out << (i == 0 ? "" : " ") << buf;
+        }
+    }
+}
+
+void generator::write_network(const NetworkOptions& options, std::ostream& out) {
+    if (options.num_nodes < 1 || options.num_states < 2 || options.in_degree < 0 || options.treewidth < 0)
+        throw std::invalid_argument("Invalid network options.");
+
+    std::mt19937 gen(options.seed);
+    std::uniform_real_distribution<float> share(0, 1);
+
+    out << "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n";
+    out << "<smile version=\"1.0\" id=\"Synthetic\" numsamples=\"1000\" discsamples=\"10000\">\n";
+    out << "\t<nodes>\n";
+
+    std::vector<int> candidates;
+    for (int i = 0; i < options.num_nodes; i++) {
+        // parents are drawn among the previous 'treewidth' nodes
+        candidates.clear();
+        for (int j = std::max(0, i - options.treewidth); j < i; j++)
+            candidates.push_back(j);
+        std::shuffle(candidates.begin(), candidates.end(), gen);
+        int n_parents = std::min(options.in_degree, (int) candidates.size());
+        std::vector<int> parents(candidates.begin(), candidates.begin() + n_parents);
+        std::sort(parents.begin(), parents.end());
+
+        size_t n_rows = 1;
+        for (int p = 0; p < n_parents; p++)
+            n_rows *= options.num_states;
+
+        bool deterministic = !parents.empty() && share(gen) < options.deterministic_share;
+        const char* tag = deterministic ? "deterministic" : "cpt";
+
+        out << "\t\t<" << tag << " id=\"" << node_name(i) << "\">\n";
+        for (int s = 0; s < options.num_states; s++)
+            out << "\t\t\t<state id=\"" << state_name(s) << "\" />\n";
+
+        if (!parents.empty()) {
+            out << "\t\t\t<parents>";
+            for (int p = 0; p < n_parents; p++)
+                out << (p == 0 ? "" : " ") << node_name(parents[p]);
+            out << "</parents>\n";
+        }
+
+        if (deterministic) {
+            std::uniform_int_distribution<int> state(0, options.num_states - 1);
+            out << "\t\t\t<resultingstates>";
+            for (size_t r = 0; r < n_rows; r++)
+                out << (r == 0 ? "" : " ") << state_name(state(gen));
+            out << "</resultingstates>\n";
+        } else {
+            out << "\t\t\t<probabilities>";
+            for (size_t r = 0; r < n_rows; r++) {
+                if (r != 0)
+                    out << " ";
+                write_distribution(options.num_states, gen, out);
+            }
+            out << "</probabilities>\n";
+        }
+        out << "\t\t</" << tag << ">\n";
+    }
+
+    out << "\t</nodes>\n";
+    out << "</smile>\n";
+}
+
+void generator::write_network(const NetworkOptions& options, const std::string& filename) {
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Can not open " + filename);
+    write_network(options, out);
+}
@@ -0,0 +1,30 @@
+#ifndef BAYESIANNETWORKS_NETWORKGENERATOR_H
+#define BAYESIANNETWORKS_NETWORKGENERATOR_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace generator {
+    /*
+     * Parameters of a synthetic network.
+     * Nodes are created in topological order and the parents of a node are drawn among the previous
+     * 'treewidth' nodes: the moral graph has then a bandwidth (and so a treewidth) of at most 'treewidth'.
+     */
+    struct NetworkOptions {
+        int num_nodes = 100;
+        int in_degree = 3; // maximum number of parents of each node
+        int num_states = 2; // number of states of each node
+        int treewidth = 5; // upper bound of the treewidth of the network
+        float deterministic_share = 0.0f; // share of non-root nodes written as 'deterministic' tags
+        uint32_t seed = 42;
+    };
+
+    //writes a valid .xdsl network with the given parameters. The same options always give the same network
+    void write_network(const NetworkOptions& options, std::ostream& out);
+
+    //writes the network in the given file, throws std::runtime_error if the file can not be opened
+    void write_network(const NetworkOptions& options, const std::string& filename);
+}
+
+#endif //BAYESIANNETWORKS_NETWORKGENERATOR_H
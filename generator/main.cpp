@@ -0,0 +1,36 @@
+#include <iostream>
+#include <string>
+#include "NetworkGenerator.h"
+
+/*
+ * Command line tool that writes a synthetic network, used for scaling benchmarks and stress tests.
+ * Usage: xdsl_generator output.xdsl [--nodes N] [--in-degree K] [--states S] [--treewidth W] [--deterministic P] [--seed X]
+ */
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " output.xdsl [--nodes N] [--in-degree K] [--states S] [--treewidth W]"
+                  << " [--deterministic P] [--seed X]\n";
+        return 1;
+    }
+
+    generator::NetworkOptions options;
+    try {
+        for (int i = 2; i + 1 < argc; i += 2) {
+            std::string flag = argv[i];
+            std::string value = argv[i + 1];
+            if (flag == "--nodes") options.num_nodes = std::stoi(value);
+            else if (flag == "--in-degree") options.in_degree = std::stoi(value);
+            else if (flag == "--states") options.num_states = std::stoi(value);
+            else if (flag == "--treewidth") options.treewidth = std::stoi(value);
+            else if (flag == "--deterministic") options.deterministic_share = std::stof(value);
+            else if (flag == "--seed") options.seed = (uint32_t) std::stoul(value);
+            else throw std::invalid_argument("Unknown option " + flag);
+        }
+        generator::write_network(options, argv[1]);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
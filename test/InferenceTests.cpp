@@ -0,0 +1,472 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include "baynet/NetworkRegistry.h"
+#include "TestUtils.hpp"
+
+using namespace baynet;
+
+namespace {
+    // checks a distribution returned by the library against the reference
+    void expect_near(const std::vector<float>& actual, const std::vector<double>& expected, double tolerance) {
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t k = 0; k < expected.size(); k++)
+            EXPECT_NEAR(actual[k], expected[k], tolerance) << "entry " << k;
+    }
+
+    class InferenceTest : public ::testing::TestWithParam<std::string> {
+    protected:
+        void SetUp() override {
+            graph = std::make_unique<Graph>(test::data_file(GetParam()));
+            graph->set_rounding(false);
+            network = std::make_unique<test::Network>(test::data_file(GetParam()));
+            enumeration = std::make_unique<test::Enumeration>(*network);
+        }
+
+        // returns the posteriors of the given nodes (indexes of network) computed by the string API
+        std::vector<std::vector<float>> posteriors(const std::vector<int>& nodes, const test::Evidence& evidence, int num_samples,
+                                                   int algorithm) {
+            std::vector<std::vector<float>> result;
+            if (evidence.empty()) {
+                auto all = graph->inference(num_samples, "", algorithm);
+                for (int node : nodes)
+                    result.push_back(all[network->names[node]]);
+                return result;
+            }
+            std::string evidence_string = test::evidence_string(*network, evidence);
+            for (int node : nodes)
+                result.push_back(graph->single_node_inference(network->names[node] + "|" + evidence_string, num_samples, algorithm));
+            return result;
+        }
+
+        // returns the evidence in the form of the typed API
+        std::vector<EvidenceItem> items(const test::Evidence& evidence) const {
+            std::vector<EvidenceItem> result;
+            for (const auto& [node, state] : evidence) {
+                NodeId id = graph->resolve_node(network->names[node]);
+                result.push_back({id, graph->resolve_state(id, network->states[node][state])});
+            }
+            return result;
+        }
+
+        // returns the states (indexes of network) of the explained nodes and of the evidence, -1 for the other nodes
+        std::vector<int> explained_states(const Explanation& explanation, const test::Evidence& evidence) const {
+            std::vector<int> states(network->names.size(), -1);
+            for (const auto& [node, state] : evidence)
+                states[node] = state;
+            for (const EvidenceItem& item : explanation.assignment) {
+                int node = network->index(std::string(graph->node_list[item.node].get_name()));
+                states[node] = network->state_index(node, std::string(graph->node_list[item.node].get_state(item.state)));
+            }
+            return states;
+        }
+
+        // returns the probability of the most likely joint state consistent with the evidence
+        double best_joint(const test::Evidence& evidence) const {
+            double best = 0;
+            std::vector<int> states(network->names.size());
+            for (size_t j = 0; j < enumeration->joint.size(); j++) {
+                enumeration->decode(j, states);
+                if (test::Enumeration::consistent(states, evidence))
+                    best = std::max(best, enumeration->joint[j]);
+            }
+            return best;
+        }
+
+        std::unique_ptr<Graph> graph;
+        std::unique_ptr<test::Network> network;
+        std::unique_ptr<test::Enumeration> enumeration;
+    };
+}
+
+TEST_P(InferenceTest, VariableEliminationMatchesEnumeration) {
+    std::vector<int> nodes(network->names.size());
+    for (int i = 0; i < (int) nodes.size(); i++)
+        nodes[i] = i;
+    for (const test::Evidence& evidence : test::scenarios(*network)) {
+        if (enumeration->probability(evidence) <= 0)
+            continue;
+        std::vector<std::vector<float>> results = posteriors(nodes, evidence, 0, 2);
+        for (int i : nodes)
+            expect_near(results[i], enumeration->posterior({i}, evidence), 1e-4);
+    }
+}
+
+TEST_P(InferenceTest, TypedQueriesMatchEnumeration) {
+    for (const test::Evidence& evidence : test::scenarios(*network)) {
+        if (enumeration->probability(evidence) <= 0)
+            continue;
+        for (int i = 0; i < (int) network->names.size(); i++) {
+            NodeId id = graph->resolve_node(network->names[i]);
+            std::vector<float> result = graph->single_node_inference(id, items(evidence), 0, 2);
+            // the states of the graph can be listed in another order than in the file
+            std::vector<double> expected = enumeration->posterior({i}, evidence);
+            ASSERT_EQ(result.size(), expected.size());
+            for (int s = 0; s < (int) expected.size(); s++)
+                EXPECT_NEAR(result[graph->resolve_state(id, network->states[i][s])], expected[s], 1e-4);
+        }
+    }
+}
+
+TEST_P(InferenceTest, UnknownAlgorithmIsRejected) {
+    std::vector<EvidenceItem> none;
+    std::vector<EvidenceItem> leaf = items(test::scenarios(*network)[1]);
+    std::vector<NodeId> query = {0};
+    for (int algorithm : {-1, 3, 7}) {
+        EXPECT_THROW(graph->single_node_inference(0, none, 100, algorithm), std::invalid_argument);
+        EXPECT_THROW(graph->single_node_inference(0, leaf, 100, algorithm), std::invalid_argument);
+        EXPECT_THROW(graph->joint_inference(query, leaf, 100, algorithm), std::invalid_argument);
+        EXPECT_THROW(graph->evidence_probability(none, 100, algorithm), std::invalid_argument);
+        EXPECT_THROW(graph->evidence_probability(leaf, 100, algorithm), std::invalid_argument);
+    }
+}
+
+TEST_P(InferenceTest, SamplingAgreesWithEnumeration) {
+    std::vector<int> nodes = {0, (int) network->names.size() / 2, (int) network->names.size() - 1};
+    for (const test::Evidence& evidence : test::scenarios(*network)) {
+        double evidence_probability = enumeration->probability(evidence);
+        if (evidence_probability <= 0)
+            continue;
+        std::vector<std::vector<float>> weighted = posteriors(nodes, evidence, 20000, 0);
+        // rejection sampling keeps too few samples when the evidence is unlikely
+        std::vector<std::vector<float>> rejection = evidence_probability > 0.05 ? posteriors(nodes, evidence, 20000, 1)
+                                                                                  : std::vector<std::vector<float>>();
+        for (size_t k = 0; k < nodes.size(); k++) {
+            std::vector<double> expected = enumeration->posterior({nodes[k]}, evidence);
+            expect_near(weighted[k], expected, 0.03);
+            if (!rejection.empty())
+                expect_near(rejection[k], expected, 0.03);
+        }
+    }
+}
+
+TEST_P(InferenceTest, MostProbableExplanationIsTheMaximum) {
+    for (const test::Evidence& evidence : test::scenarios(*network)) {
+        double best = best_joint(evidence);
+        if (best <= 0)
+            continue;
+        std::vector<EvidenceItem> evidence_items = items(evidence);
+        for (const Explanation& explanation : {graph->most_probable_explanation(evidence_items), graph->approximate_mpe(evidence_items)}) {
+            EXPECT_NEAR(explanation.log_probability, std::log(best), 1e-4);
+            std::vector<int> states = explained_states(explanation, evidence);
+            ASSERT_EQ(std::count(states.begin(), states.end(), -1), 0);
+            double p = 1;
+            for (int i = 0; i < (int) states.size(); i++)
+                p *= network->probability(i, states);
+            EXPECT_NEAR(std::log(p), std::log(best), 1e-4);
+        }
+    }
+}
+
+TEST_P(InferenceTest, MaximumAPosterioriIsTheMaximum) {
+    std::vector<int> nodes = {1, (int) network->names.size() - 2};
+    std::vector<NodeId> ids = {graph->resolve_node(network->names[nodes[0]]), graph->resolve_node(network->names[nodes[1]])};
+    for (const test::Evidence& evidence : test::scenarios(*network)) {
+        double evidence_probability = enumeration->probability(evidence);
+        if (evidence_probability <= 0)
+            continue;
+        std::vector<double> posterior = enumeration->posterior(nodes, evidence);
+        double best = *std::max_element(posterior.begin(), posterior.end()) * evidence_probability;
+
+        Explanation explanation = graph->maximum_a_posteriori(ids, items(evidence));
+        EXPECT_NEAR(explanation.log_probability, std::log(best), 1e-4);
+        std::vector<int> states = explained_states(explanation, evidence);
+        size_t index = states[nodes[0]] * enumeration->cards[nodes[1]] + states[nodes[1]];
+        EXPECT_NEAR(posterior[index] * evidence_probability, best, 1e-6);
+    }
+}
+
+TEST_P(InferenceTest, JointInferenceMatchesEnumeration) {
+    std::vector<int> query = {0, (int) network->names.size() / 2, (int) network->names.size() - 1};
+    std::vector<NodeId> ids;
+    for (int node : query)
+        ids.push_back(graph->resolve_node(network->names[node]));
+    for (const test::Evidence& evidence : test::scenarios(*network)) {
+        if (enumeration->probability(evidence) <= 0)
+            continue;
+        std::vector<double> expected = enumeration->posterior(query, evidence);
+        expect_near(graph->joint_inference(ids, items(evidence), 0, 2), expected, 1e-4);
+        expect_near(graph->joint_inference(ids, items(evidence), 50000, 0), expected, 0.02);
+    }
+}
+
+TEST_P(InferenceTest, EvidenceProbabilityMatchesEnumeration) {
+    for (const test::Evidence& evidence : test::scenarios(*network)) {
+        double expected = enumeration->probability(evidence);
+        std::vector<EvidenceItem> evidence_items = items(evidence);
+        EXPECT_NEAR(graph->evidence_probability(evidence_items, 0, 2).probability, expected, 1e-5 + 1e-4 * expected);
+        for (int algorithm : {0, 1}) {
+            EvidenceProbability estimate = graph->evidence_probability(evidence_items, 100000, algorithm);
+            EXPECT_EQ(estimate.samples_used, evidence.empty() ? 0 : 100000);
+            EXPECT_NEAR(estimate.probability, expected, 5 * std::sqrt(estimate.variance) + 1e-3) << "algorithm " << algorithm;
+        }
+    }
+
+    // an estimate always has a sample, even when the query is cancelled before it starts
+    std::vector<EvidenceItem> evidence_items = items({{(int) network->names.size() - 1, 0}});
+    QueryControl cancelled;
+    cancelled.cancellation.cancel();
+    for (int algorithm : {0, 1}) {
+        EXPECT_THROW(graph->evidence_probability(evidence_items, 0, algorithm), std::invalid_argument);
+        EvidenceProbability estimate = graph->evidence_probability(evidence_items, 1000, algorithm, cancelled);
+        EXPECT_GE(estimate.samples_used, 1);
+        EXPECT_TRUE(std::isfinite(estimate.probability)) << "algorithm " << algorithm;
+    }
+}
+
+TEST_P(InferenceTest, ScoreRowsMatchesEnumeration) {
+    // complete rows spread over the joint states, the same rows with every other node missing, the evidence of the scenarios
+    std::vector<test::Evidence> rows;
+    size_t n_nodes = network->names.size();
+    for (size_t j : {(size_t) 0, enumeration->joint.size() / 3, enumeration->joint.size() / 2, enumeration->joint.size() - 1,
+                     (size_t) (std::max_element(enumeration->joint.begin(), enumeration->joint.end()) - enumeration->joint.begin())}) {
+        std::vector<int> states(n_nodes);
+        enumeration->decode(j, states);
+        test::Evidence complete, partial;
+        for (int i = 0; i < (int) n_nodes; i++) {
+            complete.emplace_back(i, states[i]);
+            if (i % 2 == 1)
+                partial.emplace_back(i, states[i]);
+        }
+        rows.push_back(complete);
+        rows.push_back(partial);
+    }
+    for (const test::Evidence& evidence : test::scenarios(*network))
+        rows.push_back(evidence);
+
+    // column-major matrix of the states, in the order of node_list
+    std::vector<int> states(n_nodes * rows.size(), -1);
+    for (size_t r = 0; r < rows.size(); r++)
+        for (const EvidenceItem& item : items(rows[r]))
+            states[item.node * rows.size() + r] = item.state;
+    std::vector<double> scores = graph->score_rows(states, rows.size());
+    ASSERT_EQ(scores.size(), rows.size());
+    for (size_t r = 0; r < rows.size(); r++) {
+        double expected = enumeration->probability(rows[r]);
+        if (expected <= 0)
+            EXPECT_EQ(scores[r], -std::numeric_limits<double>::infinity()) << "row " << r;
+        else
+            EXPECT_NEAR(scores[r], std::log(expected), 1e-4) << "row " << r;
+    }
+    std::vector<int> out_of_range(n_nodes, 0);
+    out_of_range[0] = (int) graph->node_list[0].get_n_states();
+    EXPECT_THROW(graph->score_rows(out_of_range, 1), std::invalid_argument);
+}
+
+INSTANTIATE_TEST_SUITE_P(Networks, InferenceTest, ::testing::ValuesIn(test::networks),
+                         [](const ::testing::TestParamInfo<std::string>& info) {
+                             return info.param.substr(0, info.param.find('.'));
+                         });
+
+// the decomposition of variable elimination and the samplers must follow the noisy-MAX distribution for every row
+TEST(NoisyMaxTest, InferenceMatchesEnumeration) {
+    std::string path = (std::filesystem::temp_directory_path() / "baynet_noisymax.xdsl").string();
+    {
+        std::ofstream out(path);
+        out << "<?xml version=\"1.0\"?>\n<smile version=\"1.0\" id=\"Noisy\">\n<nodes>\n"
+               "<cpt id=\"A\"><state id=\"a0\" /><state id=\"a1\" /><probabilities>0.3 0.7</probabilities></cpt>\n"
+               "<cpt id=\"B\"><state id=\"b0\" /><state id=\"b1\" /><state id=\"b2\" /><probabilities>0.2 0.5 0.3</probabilities></cpt>\n"
+               "<noisymax id=\"C\"><state id=\"high\" /><state id=\"low\" /><state id=\"absent\" /><parents>A B</parents>"
+               "<strengths>0 1 0 1 2</strengths>"
+               "<parameters>0.6 0.3 0.1 0 0 1 0.2 0.5 0.3 0.1 0.2 0.7 0 0 1 0.05 0.05 0.9</parameters></noisymax>\n"
+               "<cpt id=\"D\"><state id=\"d0\" /><state id=\"d1\" /><parents>C</parents><probabilities>0.9 0.1 0.5 0.5 0.2 0.8</probabilities></cpt>\n"
+               "</nodes>\n</smile>\n";
+    }
+    Graph graph(path);
+    test::Network network(path);
+    std::remove(path.c_str());
+    graph.set_rounding(false);
+    test::Enumeration enumeration(network);
+    for (const test::Evidence& evidence : std::vector<test::Evidence>{{{3, 0}}, {{2, 1}}, {{0, 0}, {3, 1}}}) {
+        std::string evidence_string = test::evidence_string(network, evidence);
+        for (int i = 0; i < 4; i++) {
+            std::vector<double> expected = enumeration.posterior({i}, evidence);
+            expect_near(graph.single_node_inference(network.names[i] + "|" + evidence_string, 0, 2), expected, 1e-6);
+            expect_near(graph.single_node_inference(network.names[i] + "|" + evidence_string, 20000, 0), expected, 0.03);
+        }
+    }
+    std::unordered_map<std::string, std::vector<float>> priors = graph.inference(0, "", 2);
+    for (int i = 0; i < 4; i++)
+        expect_near(priors[network.names[i]], enumeration.posterior({i}, {}), 1e-6);
+}
+
+// the weights of likelihood weighting are the exact probabilities of the evidence, however small
+TEST(RareStateTest, WeightsKeepSmallProbabilities) {
+    std::string path = test::write_network("baynet_rare.xdsl", test::rare_state_network);
+    Graph graph(path);
+    test::Network network(path);
+    std::remove(path.c_str());
+    graph.set_rounding(false);
+    test::Enumeration enumeration(network);
+
+    test::Evidence broken = {{0, 1}};
+    std::vector<EvidenceItem> items = {{graph.resolve_node("Fault"), graph.resolve_state(graph.resolve_node("Fault"), "broken")}};
+    NodeId alarm = graph.resolve_node("Alarm");
+    std::vector<double> expected = enumeration.posterior({1}, broken);
+    expect_near(graph.single_node_inference(alarm, items, 0, 2), expected, 1e-6);
+    expect_near(graph.single_node_inference(alarm, items, 20000, 0), expected, 0.03);
+    expect_near(graph.single_node_inference("Alarm|Fault=broken", 20000, 0), expected, 0.03);
+
+    double probability = enumeration.probability(broken);
+    EXPECT_NEAR(graph.evidence_probability(items, 0, 2).probability, probability, 1e-4 * probability);
+    EXPECT_NEAR(graph.evidence_probability(items, 20000, 0).probability, probability, 1e-4 * probability);
+}
+
+// the unnormalised posteriors of variable elimination can be far below the smallest float
+TEST(RareStateTest, PosteriorsAreNormalisedInDouble) {
+    std::string path = test::write_network("baynet_tiny.xdsl",
+            "<?xml version=\"1.0\"?>\n<smile version=\"1.0\" id=\"Tiny\">\n<nodes>\n"
+            "<cpt id=\"A\"><state id=\"common\" /><state id=\"rare\" /><probabilities>1 1e-30</probabilities></cpt>\n"
+            "<cpt id=\"B\"><state id=\"common\" /><state id=\"rare\" /><probabilities>1 1e-30</probabilities></cpt>\n"
+            "<cpt id=\"C\"><state id=\"c0\" /><state id=\"c1\" /><parents>A B</parents>"
+            "<probabilities>0.5 0.5 0.5 0.5 0.5 0.5 0.3 0.7</probabilities></cpt>\n"
+            "</nodes>\n</smile>\n");
+    Graph graph(path);
+    std::remove(path.c_str());
+    graph.set_rounding(false);
+    std::vector<float> posterior = graph.single_node_inference("C|A=rare,B=rare", 0, 2);
+    ASSERT_EQ(posterior.size(), 2u);
+    EXPECT_NEAR(posterior[0], 0.3, 1e-6);
+    EXPECT_NEAR(posterior[1], 0.7, 1e-6);
+}
+
+// the log-probability of a row is the sum of the logs of the exact probabilities, not of differences of prefix sums
+TEST(RareStateTest, ScoreRowsKeepSmallProbabilities) {
+    std::string path = test::write_network("baynet_rare_rows.xdsl", test::rare_state_network);
+    Graph graph(path);
+    test::Network network(path);
+    std::remove(path.c_str());
+    test::Enumeration enumeration(network);
+
+    // (broken, on), (broken, missing), (missing, on), (ok, off)
+    std::vector<test::Evidence> rows = {{{0, 1}, {1, 0}}, {{0, 1}}, {{1, 0}}, {{0, 0}, {1, 1}}};
+    NodeId fault = graph.resolve_node("Fault"), alarm = graph.resolve_node("Alarm");
+    std::vector<int> states(graph.node_list.size() * rows.size(), -1);
+    for (size_t r = 0; r < rows.size(); r++)
+        for (const auto& [node, state] : rows[r]) {
+            NodeId id = node == 0 ? fault : alarm;
+            states[id * rows.size() + r] = graph.resolve_state(id, network.states[node][state]);
+        }
+    std::vector<double> scores = graph.score_rows(states, rows.size());
+    ASSERT_EQ(scores.size(), rows.size());
+    for (size_t r = 0; r < rows.size(); r++)
+        EXPECT_NEAR(scores[r], std::log(enumeration.probability(rows[r])), 1e-4) << "row " << r;
+    EXPECT_NEAR(scores[0], std::log(9e-9), 1e-4);
+}
+
+// the explanations of a rare evidence keep its probability instead of finding it impossible
+TEST(RareStateTest, ExplanationsKeepSmallProbabilities) {
+    std::string path = test::write_network("baynet_rare_mpe.xdsl", test::rare_state_network);
+    Graph graph(path);
+    std::remove(path.c_str());
+
+    NodeId fault = graph.resolve_node("Fault"), alarm = graph.resolve_node("Alarm");
+    std::vector<EvidenceItem> evidence = {{fault, graph.resolve_state(fault, "broken")}};
+    for (const Explanation& explanation : {graph.most_probable_explanation(evidence), graph.approximate_mpe(evidence)}) {
+        EXPECT_NEAR(explanation.log_probability, std::log(9e-9), 1e-4);
+        ASSERT_EQ(explanation.assignment.size(), 1u);
+        EXPECT_EQ(explanation.assignment[0].node, alarm);
+        EXPECT_EQ(graph.node_list[alarm].get_state(explanation.assignment[0].state), "on");
+    }
+}
+
+// the graphs loaded without a pool, those of a registry included, run on the pool of the process
+TEST(ThreadPoolTest, GraphsShareThePoolOfTheProcess) {
+    std::shared_ptr<ThreadPool> shared = ThreadPool::shared();
+    long users = shared.use_count();
+    {
+        NetworkRegistry registry;
+        for (const std::string& name : test::networks)
+            registry.load(name, test::data_file(name));
+        EXPECT_EQ(shared.use_count(), users + (long) test::networks.size());
+
+        LoadOptions options;
+        options.pool = std::make_shared<ThreadPool>(2);
+        Graph own(test::data_file(test::networks[0]), options);
+        EXPECT_EQ(own.get_num_threads(), 2);
+        EXPECT_EQ(options.pool.use_count(), 2);
+        EXPECT_EQ(shared.use_count(), users + (long) test::networks.size());
+        EXPECT_EQ(own.single_node_inference(0, {}, 1000, 0).size(), own.node_list[0].get_n_states());
+    }
+    EXPECT_EQ(shared.use_count(), users);
+}
+
+// more queries than workers: each one holds a worker and runs its sampling tasks there if no other worker is free
+TEST(ThreadPoolTest, AsyncQueriesDoNotExhaustThePool) {
+    LoadOptions options;
+    options.pool = std::make_shared<ThreadPool>(2);
+    std::vector<std::future<std::vector<float>>> left;
+    {
+        Graph graph(test::data_file("AsiaDiagnosis.xdsl"), options);
+        graph.set_rounding(false);
+        std::vector<float> exact = graph.single_node_inference(0, {}, 0, 2);
+        std::vector<std::future<std::vector<float>>> pending;
+        for (int i = 0; i < 16; i++)
+            pending.push_back(graph.single_node_inference_async(0, {}, 20000, 0));
+        for (auto& result : pending)
+            expect_near(result.get(), std::vector<double>(exact.begin(), exact.end()), 0.03);
+
+        // the graph waits for the queries still queued when it is destroyed
+        for (int i = 0; i < 16; i++)
+            left.push_back(graph.single_node_inference_async(0, {}, 20000, 0));
+    }
+    for (auto& result : left)
+        EXPECT_EQ(result.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+}
+
+// the string queries and the query of all the nodes stop at the cancellation of their control
+TEST(QueryControlTest, StringAndAllNodesQueriesAreBounded) {
+    Graph graph(test::data_file("AsiaDiagnosis.xdsl"));
+    graph.set_rounding(false);
+    std::string evidence = "Smoking=Smoker";
+    std::vector<EvidenceItem> items = graph.resolve_evidence(evidence);
+    NodeId bronchitis = graph.resolve_node("Bronchitis");
+    std::vector<float> exact = graph.single_node_inference(bronchitis, items, 0, 2);
+    std::vector<double> expected(exact.begin(), exact.end());
+
+    QueryControl open;
+    QueryResult single = graph.single_node_inference("Bronchitis|" + evidence, 20000, 0, open);
+    EXPECT_EQ(single.samples_used, 20000);
+    EXPECT_FALSE(single.stopped);
+    expect_near(single.probabilities, expected, 0.03);
+    std::unordered_map<std::string, QueryResult> all = graph.inference(20000, evidence, 0, open);
+    ASSERT_EQ(all.size(), graph.node_list.size());
+    expect_near(all["Bronchitis|" + evidence].probabilities, expected, 0.03);
+
+    QueryControl cancelled;
+    cancelled.cancellation.cancel();
+    single = graph.single_node_inference("Bronchitis|" + evidence, 1000000, 0, cancelled);
+    EXPECT_TRUE(single.stopped);
+    EXPECT_GT(single.samples_used, 0);
+    EXPECT_LT(single.samples_used, 1000000);
+    std::vector<QueryResult> typed = graph.inference(items, 1000000, 0, cancelled);
+    ASSERT_EQ(typed.size(), graph.node_list.size());
+    for (int i = 0; i < (int) typed.size(); i++) {
+        EXPECT_TRUE(typed[i].stopped) << graph.node_list[i].get_name();
+        EXPECT_EQ(typed[i].probabilities.size(), graph.node_list[i].get_n_states());
+    }
+    EXPECT_TRUE(graph.inference(1000000, "Smoking=Unknown", 0, cancelled).empty());
+}
+
+// the bundled network with equation nodes loads the part that does not depend on them, and reports the rest
+TEST(LoadTest, UnsupportedNodesAreSkipped) {
+    Graph graph(test::data_file("AirConditioning.xdsl"));
+    std::vector<std::string> skipped = {"Toa", "u_d", "Tra", "Tma", "m_flow_ma", "sp_heat_air", "Tsa", "mdot_cw", "sp_heat_water",
+                                        "T_cw_in", "T_cw_out", "Perceived_Temperature"};
+    EXPECT_EQ(graph.skipped_nodes(), skipped);
+    ASSERT_EQ(graph.node_list.size(), 1u);
+    EXPECT_EQ(graph.node_list[0].get_name(), "Season");
+    std::vector<float> prior = graph.single_node_inference(0, {}, 0, 2);
+    EXPECT_NEAR(std::accumulate(prior.begin(), prior.end(), 0.0), 1, 1e-6);
+
+    LoadOptions strict;
+    strict.skip_unsupported_nodes = false;
+    EXPECT_THROW(Graph(test::data_file("AirConditioning.xdsl"), strict), std::runtime_error);
+    EXPECT_TRUE(Graph(test::data_file("AsiaDiagnosis.xdsl"), strict).skipped_nodes().empty());
+}
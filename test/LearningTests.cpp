@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "baynet/StructureLearner.h"
+#include "TestUtils.hpp"
+
+using namespace baynet;
+
+namespace {
+    // writes num_cases cases sampled from the network as a CSV file, a value is left empty with probability missing
+    void write_cases(Graph& network, const std::string& path, int num_cases, double missing = 0) {
+        std::ofstream out(path);
+        for (size_t i = 0; i < network.node_list.size(); i++)
+            out << (i == 0 ? "" : ",") << network.node_list[i].get_name();
+        out << "\n";
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        for (int c = 0; c < num_cases; c++) {
+            std::unordered_map<std::string, std::string> sample = network.prior_sample();
+            for (size_t i = 0; i < network.node_list.size(); i++)
+                out << (i == 0 ? "" : ",") << (uniform(gen) < missing ? "" : sample[std::string(network.node_list[i].get_name())]);
+            out << "\n";
+        }
+    }
+
+    std::string temp_file(const std::string& name) {
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+}
+
+// every iteration of EM can not lower the log-likelihood of the cases, and the iterations converge to the generating network
+TEST(ExpectationMaximisationTest, LogLikelihoodNeverDecreases) {
+    Graph truth(test::data_file("AsiaDiagnosis.xdsl"));
+    truth.set_rounding(false);
+    std::string start_csv = temp_file("baynet_em_start.csv");
+    std::string csv = temp_file("baynet_em_cases.csv");
+    write_cases(truth, start_csv, 200);
+    write_cases(truth, csv, 5000, 0.3);
+
+    // both runs start from the cpts learned from a few complete cases, smoothed so that no case is impossible
+    LearnOptions smoothed;
+    smoothed.prior = ParameterPrior::Dirichlet;
+    Graph stepwise(test::data_file("AsiaDiagnosis.xdsl"));
+    Graph converging(test::data_file("AsiaDiagnosis.xdsl"));
+    stepwise.learn_parameters(start_csv, smoothed);
+    converging.learn_parameters(start_csv, smoothed);
+
+    // one iteration per call: the log-likelihood of each call is the one under the cpts of the previous M-step
+    EmOptions one_step;
+    one_step.max_iterations = 1;
+    std::vector<double> log_likelihoods;
+    for (int i = 0; i < 15; i++) {
+        EmResult result = stepwise.learn_parameters_em(csv, one_step);
+        EXPECT_EQ(result.cases, 5000u);
+        EXPECT_EQ(result.impossible_cases, 0u);
+        log_likelihoods.push_back(result.log_likelihood);
+    }
+    for (size_t i = 1; i < log_likelihoods.size(); i++)
+        EXPECT_GE(log_likelihoods[i], log_likelihoods[i - 1] - 1e-7 * std::abs(log_likelihoods[i - 1])) << "iteration " << i;
+    EXPECT_GT(log_likelihoods.back(), log_likelihoods.front());
+
+    EmOptions options;
+    options.max_iterations = 500;
+    options.tolerance = 1e-7;
+    EmResult result = converging.learn_parameters_em(csv, options);
+    std::filesystem::remove(start_csv);
+    std::filesystem::remove(csv);
+    EXPECT_TRUE(result.converged);
+    EXPECT_LT(result.iterations, options.max_iterations);
+    EXPECT_GE(result.log_likelihood, log_likelihoods.back() - 1e-7 * std::abs(log_likelihoods.back()));
+
+    converging.set_rounding(false);
+    for (int i = 0; i < (int) truth.node_list.size(); i++)
+        for (int s = 0; s < (int) truth.node_list[i].get_n_states(); s++)
+            EXPECT_NEAR(converging.single_node_inference(i, {}, 0, 2)[s], truth.single_node_inference(i, {}, 0, 2)[s], 0.03)
+                                << truth.node_list[i].get_name();
+}
+
+// a file with a header and no case leaves the cpts as they are
+TEST(ParameterLearningTest, EmptyDatasetIsRejected) {
+    Graph graph(test::data_file("AsiaDiagnosis.xdsl"));
+    graph.set_rounding(false);
+    std::string csv = temp_file("baynet_learn_empty.csv");
+    write_cases(graph, csv, 0);
+    std::vector<std::vector<float>> before;
+    for (int i = 0; i < (int) graph.node_list.size(); i++)
+        before.push_back(graph.single_node_inference(i, {}, 0, 2));
+    EXPECT_THROW(graph.learn_parameters(csv), std::runtime_error);
+    std::filesystem::remove(csv);
+    for (int i = 0; i < (int) graph.node_list.size(); i++)
+        EXPECT_EQ(graph.single_node_inference(i, {}, 0, 2), before[i]) << graph.node_list[i].get_name();
+}
+
+// the learned network is written, reloaded, and must keep the structure and the distribution of the data
+TEST(StructureLearnerTest, LearnWriteAndReload) {
+    Graph original(test::data_file("AsiaDiagnosis.xdsl"));
+    original.set_rounding(false);
+    std::string csv = temp_file("baynet_structure_cases.csv");
+    write_cases(original, csv, 20000);
+
+    StructureLearner learner(csv);
+    StructureResult result = learner.learn();
+    EXPECT_GT(result.iterations, 0);
+    std::string xdsl = temp_file("baynet_structure_learned.xdsl");
+    std::unique_ptr<Graph> learned = learner.make_graph(xdsl);
+    learned->set_rounding(false);
+    std::filesystem::remove(csv);
+    std::filesystem::remove(xdsl);
+
+    const std::vector<std::string>& names = learner.get_names();
+    ASSERT_EQ(learned->node_list.size(), names.size());
+    for (size_t v = 0; v < names.size(); v++) {
+        NodeId id = learned->resolve_node(names[v]);
+        std::vector<std::string> parents;
+        for (int parent : learned->view(id).parents())
+            parents.emplace_back(learned->node_list[parent].get_name());
+        std::vector<std::string> expected;
+        for (int parent : learner.get_parents()[v])
+            expected.push_back(names[parent]);
+        EXPECT_EQ(parents, expected) << names[v];
+
+        // the marginals of the learned network are the ones of the data, close to the ones of the original network
+        NodeId original_id = original.resolve_node(names[v]);
+        std::vector<float> original_marginal = original.single_node_inference(original_id, {}, 0, 2);
+        std::vector<float> learned_marginal = learned->single_node_inference(id, {}, 0, 2);
+        ASSERT_EQ(learned_marginal.size(), original_marginal.size());
+        for (int s = 0; s < (int) learned_marginal.size(); s++) {
+            StateId original_state = original.resolve_state(original_id, learned->node_list[id].get_state(s));
+            EXPECT_NEAR(learned_marginal[s], original_marginal[original_state], 0.02) << names[v];
+        }
+    }
+}
+
+TEST(StructureLearnerTest, InvalidIdsAreRejected) {
+    std::string csv = temp_file("baynet_structure_ids.csv");
+    std::string xdsl = temp_file("baynet_structure_ids.xdsl");
+    std::filesystem::remove(xdsl);
+    // content of the dataset, the column or the value that must be named by the exception
+    std::vector<std::pair<std::string, std::string>> datasets = {{"A,2nd\nx,y\nz,y\n", "2nd"}, {"A,B\nx,y\nz,1\n", "1"},
+                                                                 {"A,B\nx,y\nz,a<b\n", "a<b"}, {"A,B C\nx,y\nz,y\n", "B C"}};
+    for (const auto& [content, bad] : datasets) {
+        {
+            std::ofstream out(csv);
+            out << content;
+        }
+        StructureLearner learner(csv);
+        learner.learn();
+        try {
+            learner.write_xdsl(xdsl);
+            ADD_FAILURE() << "no exception for " << bad;
+        } catch (const std::invalid_argument& e) {
+            EXPECT_NE(std::string(e.what()).find("\"" + bad + "\""), std::string::npos) << e.what();
+        }
+        EXPECT_FALSE(std::filesystem::exists(xdsl)) << bad;
+    }
+    {
+        std::ofstream out(csv);
+        out << "_A,b_1\nx,y\nz,y\n";
+    }
+    StructureLearner learner(csv);
+    learner.learn();
+    EXPECT_NO_THROW(learner.write_xdsl(xdsl));
+    std::filesystem::remove(csv);
+    std::filesystem::remove(xdsl);
+}
+
+// a file with a header and no case leaves the cpts as they are
+TEST(ExpectationMaximisationTest, EmptyDatasetIsRejected) {
+    Graph graph(test::data_file("AsiaDiagnosis.xdsl"));
+    graph.set_rounding(false);
+    std::string csv = temp_file("baynet_em_empty.csv");
+    {
+        std::ofstream out(csv);
+        for (size_t i = 0; i < graph.node_list.size(); i++)
+            out << (i == 0 ? "" : ",") << graph.node_list[i].get_name();
+        out << "\n";
+    }
+    std::vector<std::vector<float>> before;
+    for (int i = 0; i < (int) graph.node_list.size(); i++)
+        before.push_back(graph.single_node_inference(i, {}, 0, 2));
+    EXPECT_THROW(graph.learn_parameters_em(csv, {}), std::runtime_error);
+    std::filesystem::remove(csv);
+    for (int i = 0; i < (int) graph.node_list.size(); i++)
+        EXPECT_EQ(graph.single_node_inference(i, {}, 0, 2), before[i]) << graph.node_list[i].get_name();
+}
+
+// the E-step reads the exact probabilities of the cases, however small, with both engines
+TEST(ExpectationMaximisationTest, RareCasesArePossible) {
+    std::string path = test::write_network("baynet_em_rare.xdsl", test::rare_state_network);
+    std::string csv = temp_file("baynet_em_rare.csv");
+    {
+        std::ofstream out(csv);
+        out << "Fault,Alarm\nbroken,on\nok,off\nbroken,\n";
+    }
+    double expected = std::log(1e-8 * 0.9) + std::log(0.99999999 * 0.99) + std::log(1e-8);
+    for (int algorithm : {2, 0}) {
+        Graph graph(path);
+        EmOptions options;
+        options.max_iterations = 1;
+        options.algorithm = algorithm;
+        EmResult result = graph.learn_parameters_em(csv, options);
+        EXPECT_EQ(result.cases, 3u);
+        EXPECT_EQ(result.impossible_cases, 0u) << "algorithm " << algorithm;
+        EXPECT_NEAR(result.log_likelihood, expected, 1e-4) << "algorithm " << algorithm;
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(csv);
+}
@@ -0,0 +1,278 @@
+#ifndef BAYESIANNETWORKS_TESTUTILS_HPP
+#define BAYESIANNETWORKS_TESTUTILS_HPP
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "baynet/Graph.h"
+
+//namespace for the helpers shared by the tests
+namespace test {
+    // networks of the data folder used by the tests, small enough to be enumerated
+    inline const std::vector<std::string> networks = {"AsiaDiagnosis.xdsl", "Animals.xdsl", "Coma.xdsl", "Credit.xdsl"};
+
+    // returns the absolute path of a file of the data folder
+    inline std::string data_file(const std::string& name) {
+        return std::string(BAYNET_DATA_DIR) + "/" + name;
+    }
+
+    // returns the text between open and close in text, starting from pos (empty if open is not found before limit)
+    inline std::string between(const std::string& text, const std::string& open, const std::string& close, size_t pos = 0,
+                               size_t limit = std::string::npos) {
+        size_t begin = text.find(open, pos);
+        if (begin == std::string::npos || begin >= limit)
+            return "";
+        begin += open.size();
+        return text.substr(begin, text.find(close, begin) - begin);
+    }
+
+    // splits a list separated by white spaces
+    inline std::vector<std::string> words(const std::string& text) {
+        std::istringstream in(text);
+        std::vector<std::string> result;
+        for (std::string word; in >> word;)
+            result.push_back(word);
+        return result;
+    }
+
+    /*
+     * Network read straight from the .xdsl file by a parser of its own, so that the reference of the tests shares no code
+     * with the library and keeps the probabilities of the file in double precision
+     */
+    struct Network {
+        explicit Network(const std::string& path) {
+            std::ifstream in(path);
+            if (!in)
+                throw std::runtime_error("Can not open " + path);
+            std::stringstream buffer;
+            buffer << in.rdbuf();
+            std::string text = buffer.str();
+            size_t pos = text.find("<nodes>");
+            size_t nodes_end = text.find("</nodes>");
+            while (true) {
+                size_t cpt = text.find("<cpt ", pos), deterministic = text.find("<deterministic ", pos);
+                size_t noisy = text.find("<noisymax ", pos);
+                size_t begin = std::min({cpt, deterministic, noisy});
+                if (begin >= nodes_end)
+                    break;
+                std::string tag = begin == cpt ? "cpt" : begin == noisy ? "noisymax" : "deterministic";
+                size_t end = text.find("</" + tag + ">", begin);
+                int node = (int) names.size();
+                names.push_back(between(text, "id=\"", "\"", begin));
+                states.emplace_back();
+                for (size_t s = text.find("<state ", begin); s < end; s = text.find("<state ", s + 1))
+                    states[node].push_back(between(text, "id=\"", "\"", s));
+                parents.emplace_back();
+                for (const std::string& parent : words(between(text, "<parents>", "</parents>", begin, end)))
+                    parents[node].push_back(index(parent));
+
+                size_t n_states = states[node].size();
+                std::vector<double>& table = cpts.emplace_back();
+                if (tag == "cpt") {
+                    for (const std::string& p : words(between(text, "<probabilities>", "</probabilities>", begin, end)))
+                        table.push_back(std::stod(p));
+                } else if (tag == "noisymax") {
+                    read_noisy_max(node, words(between(text, "<strengths>", "</strengths>", begin, end)),
+                                   words(between(text, "<parameters>", "</parameters>", begin, end)));
+                } else {
+                    // one state of the node for each row of the parents, as a one-hot distribution
+                    for (const std::string& resulting : words(between(text, "<resultingstates>", "</resultingstates>", begin, end))) {
+                        table.resize(table.size() + n_states, 0);
+                        table[table.size() - n_states + state_index(node, resulting)] = 1;
+                    }
+                }
+                pos = end;
+            }
+        }
+
+        /*
+         * Fills the cpt of a noisy-MAX node: the states are ordered from the most to the least severe, and the child takes the
+         * most severe of the states given by each parent and by the leak, so P(Y at most as severe as y) is the product of
+         * the same probability of each link. The parameters have a row for each parent state, in strengths order, then the leak
+         */
+        void read_noisy_max(int node, const std::vector<std::string>& strengths, const std::vector<std::string>& parameters) {
+            size_t n_states = states[node].size();
+            auto tail = [&](size_t parameter_row, size_t y) {
+                double sum = 0;
+                for (size_t k = y; k < n_states; k++)
+                    sum += std::stod(parameters[parameter_row * n_states + k]);
+                return sum;
+            };
+            size_t rows = 1;
+            for (int parent : parents[node])
+                rows *= states[parent].size();
+            std::vector<double>& table = cpts[node];
+            table.resize(rows * n_states);
+            for (size_t r = 0; r < rows; r++) {
+                std::vector<double> tails(n_states);
+                size_t leak_row = strengths.size();
+                for (size_t y = 0; y < n_states; y++)
+                    tails[y] = tail(leak_row, y);
+                size_t rest = r, first_row = strengths.size();
+                for (size_t p = parents[node].size(); p-- > 0;) {
+                    size_t card = states[parents[node][p]].size();
+                    int x = (int) (rest % card);
+                    rest /= card;
+                    first_row -= card;
+                    // the parameter row of state x is the position of x in the strengths of the parent
+                    size_t k = 0;
+                    while (std::stoi(strengths[first_row + k]) != x)
+                        k++;
+                    for (size_t y = 0; y < n_states; y++)
+                        tails[y] *= tail(first_row + k, y);
+                }
+                for (size_t y = 0; y < n_states; y++)
+                    table[r * n_states + y] = tails[y] - (y + 1 < n_states ? tails[y + 1] : 0);
+            }
+        }
+
+        // returns the index of a node by name
+        int index(const std::string& name) const {
+            for (size_t i = 0; i < names.size(); i++)
+                if (names[i] == name)
+                    return (int) i;
+            throw std::invalid_argument("No node " + name);
+        }
+
+        // returns the index of a state of a node by name
+        int state_index(int node, const std::string& state) const {
+            for (size_t s = 0; s < states[node].size(); s++)
+                if (states[node][s] == state)
+                    return (int) s;
+            throw std::invalid_argument("No state " + state + " of " + names[node]);
+        }
+
+        // returns P(states[node] | states of its parents), states has a state for each node
+        double probability(int node, const std::vector<int>& node_states) const {
+            size_t row = 0;
+            for (int parent : parents[node])
+                row = row * states[parent].size() + node_states[parent];
+            return cpts[node][row * states[node].size() + node_states[node]];
+        }
+
+        std::vector<std::string> names; // in the order of the file
+        std::vector<std::vector<std::string>> states;
+        std::vector<std::vector<int>> parents;
+        std::vector<std::vector<double>> cpts; // a row for each configuration of the parents, the last parent changing fastest
+    };
+
+    // a root whose rare state follows a large probability (as floats, 1 - 1e-8 and 1 are the same prefix sum) and its child
+    inline const std::string rare_state_network =
+            "<?xml version=\"1.0\"?>\n<smile version=\"1.0\" id=\"Rare\">\n<nodes>\n"
+            "<cpt id=\"Fault\"><state id=\"ok\" /><state id=\"broken\" /><probabilities>0.99999999 0.00000001</probabilities></cpt>\n"
+            "<cpt id=\"Alarm\"><state id=\"on\" /><state id=\"off\" /><parents>Fault</parents>"
+            "<probabilities>0.01 0.99 0.9 0.1</probabilities></cpt>\n"
+            "</nodes>\n</smile>\n";
+
+    // writes a network in the temporary folder and returns the path of the file
+    inline std::string write_network(const std::string& name, const std::string& xdsl) {
+        std::string path = (std::filesystem::temp_directory_path() / name).string();
+        std::ofstream out(path);
+        out << xdsl;
+        return path;
+    }
+
+    // evidence as (node, state) indexes of a Network
+    using Evidence = std::vector<std::pair<int, int>>;
+
+    /*
+     * Joint distribution of all the nodes of a network, computed by enumeration: the reference of the inference tests.
+     * Joint states are mixed-radix numbers of the node states, the last node changing fastest
+     */
+    class Enumeration {
+    public:
+        explicit Enumeration(const Network& network) {
+            size_t size = 1;
+            for (const auto& node_states : network.states) {
+                cards.push_back((int) node_states.size());
+                size *= node_states.size();
+            }
+            joint.resize(size);
+            std::vector<int> states(cards.size());
+            for (size_t j = 0; j < size; j++) {
+                decode(j, states);
+                double p = 1;
+                for (int i = 0; i < (int) cards.size() && p > 0; i++)
+                    p *= network.probability(i, states);
+                joint[j] = p;
+            }
+        }
+
+        // writes the state of every node of joint state j
+        void decode(size_t j, std::vector<int>& states) const {
+            for (int i = (int) cards.size() - 1; i >= 0; i--) {
+                states[i] = (int) (j % cards[i]);
+                j /= cards[i];
+            }
+        }
+
+        // returns true if the states agree with the evidence
+        static bool consistent(const std::vector<int>& states, const Evidence& evidence) {
+            for (const auto& [node, state] : evidence)
+                if (states[node] != state)
+                    return false;
+            return true;
+        }
+
+        // returns P(evidence)
+        double probability(const Evidence& evidence) const {
+            std::vector<int> states(cards.size());
+            double p = 0;
+            for (size_t j = 0; j < joint.size(); j++) {
+                decode(j, states);
+                if (consistent(states, evidence))
+                    p += joint[j];
+            }
+            return p;
+        }
+
+        // returns P(query | evidence), the joint states of the query laid out like the joint states of the network
+        std::vector<double> posterior(const std::vector<int>& query, const Evidence& evidence) const {
+            size_t size = 1;
+            for (int q : query)
+                size *= cards[q];
+            std::vector<double> table(size, 0);
+            std::vector<int> states(cards.size());
+            double total = 0;
+            for (size_t j = 0; j < joint.size(); j++) {
+                decode(j, states);
+                if (!consistent(states, evidence))
+                    continue;
+                size_t index = 0;
+                for (int q : query)
+                    index = index * cards[q] + states[q];
+                table[index] += joint[j];
+                total += joint[j];
+            }
+            for (double& p : table)
+                p /= total;
+            return table;
+        }
+
+        std::vector<int> cards; // number of states of each node
+        std::vector<double> joint; // probability of each joint state
+    };
+
+    // evidence scenarios of a network: none, the first state of the last node, the last state of the first node, both
+    inline std::vector<Evidence> scenarios(const Network& network) {
+        int last = (int) network.names.size() - 1;
+        std::pair<int, int> leaf{last, 0};
+        std::pair<int, int> root{0, (int) network.states[0].size() - 1};
+        return {{}, {leaf}, {root}, {root, leaf}};
+    }
+
+    // returns the evidence in the form of the string API: "Var1=StateX,Var2=StateY"
+    inline std::string evidence_string(const Network& network, const Evidence& evidence) {
+        std::string result;
+        for (const auto& [node, state] : evidence)
+            result += (result.empty() ? "" : ",") + network.names[node] + "=" + network.states[node][state];
+        return result;
+    }
+}
+
+#endif //BAYESIANNETWORKS_TESTUTILS_HPP